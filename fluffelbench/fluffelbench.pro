@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Fluffelbench: measures the latency from an autosplitter sending a command
+# until Fluffelwatch applied it. Plain C++, only shares the protocol header.
+#
+#-------------------------------------------------
+
+TARGET = fluffelbench
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../fluffelwatch
+
+LIBS += -pthread
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../fluffelwatch/fluffelprotocol.h
@@ -0,0 +1,313 @@
+/* Fluffelbench: load generator for measuring the time from sending a command to
+ * Fluffelwatch until its TimeController actually applied it.
+ *
+ * The benchmark connects with protocol version 2 and sends frames that pause
+ * or resume the ingame timer, each followed by a ping. Fluffelwatch answers
+ * every ping once the commands before it are applied, together with the
+ * number of pauses/resumes it applied so far. The latency is the time between
+ * the timestamp of the frame and the timestamp of the pong (both from
+ * CLOCK_MONOTONIC). The timers in Fluffelwatch need to be running. */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fluffelprotocol.h"
+
+namespace {
+    struct options {
+        std::string socketPath = "/tmp/fluffelwatch";
+        std::string output;
+        double rate = 1000.0;       /* bursts per second */
+        int count = 10000;          /* number of pause/resume transitions */
+        int burst = 1;              /* transitions sent back-to-back */
+        bool start = false;         /* send a start command first */
+    };
+
+    /* State shared between the sending and the receiving thread */
+    struct results {
+        std::mutex lock;
+        std::condition_variable changed;
+
+        std::map<uint32_t, int64_t> sent;       /* ping id -> send time */
+        std::vector<int64_t> latencies;
+        uint32_t lastPong = 0;
+        uint64_t transitions = 0;
+        bool closed = false;
+    };
+
+    int64_t monotonicNSecs() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    void usage(const char *name) {
+        printf("Usage: %s [options]\n"
+               "  -s PATH   socket of Fluffelwatch (default /tmp/fluffelwatch)\n"
+               "  -r HZ     bursts per second (default 1000)\n"
+               "  -n COUNT  number of pause/resume transitions (default 10000)\n"
+               "  -b SIZE   transitions per burst, sent back-to-back (default 1)\n"
+               "  -a        send a start command first (needs autostart/stop enabled)\n"
+               "  -o FILE   append the results as a CSV line to FILE\n", name);
+    }
+
+    bool parseOptions(int argc, char *argv[], options &opts) {
+        int c;
+        while ((c = getopt(argc, argv, "s:r:n:b:ao:h")) != -1) {
+            switch (c) {
+                case 's': opts.socketPath = optarg; break;
+                case 'r': opts.rate = atof(optarg); break;
+                case 'n': opts.count = atoi(optarg); break;
+                case 'b': opts.burst = atoi(optarg); break;
+                case 'a': opts.start = true; break;
+                case 'o': opts.output = optarg; break;
+                default: return false;
+            }
+        }
+
+        return (opts.rate > 0) && (opts.count > 0) && (opts.burst > 0);
+    }
+
+    int connectTo(const std::string &path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            return -1;
+        }
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    bool writeAll(int fd, const std::vector<char> &data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += n;
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    void append(std::vector<char> &buffer, const T &value) {
+        const char *data = reinterpret_cast<const char*>(&value);
+        buffer.insert(buffer.end(), data, data + sizeof(value));
+    }
+
+    /* Appends a frame with the given command and a ping */
+    void appendFrame(std::vector<char> &buffer, uint8_t command, uint32_t ping, int64_t timestamp) {
+        FluffelProtocol::frameHeader header;
+        header.length = (command != 0 ? 1 : 0) + 1 + sizeof(uint32_t);
+        header.timestamp = timestamp;
+
+        append(buffer, header);
+        if (command != 0) {
+            append(buffer, command);
+        }
+        append(buffer, static_cast<uint8_t>(FluffelProtocol::commandPing));
+        append(buffer, ping);
+    }
+
+    /* Reads the pongs until the connection is closed */
+    void receive(int fd, results &res) {
+        std::vector<char> buffer;
+        char chunk[4096];
+
+        while (true) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                if ((n == -1) && (errno == EINTR)) {
+                    continue;
+                }
+                break;
+            }
+
+            buffer.insert(buffer.end(), chunk, chunk + n);
+
+            /* Take all complete pongs */
+            size_t pos = 0;
+            while (buffer.size() - pos >= sizeof(FluffelProtocol::pongFrame)) {
+                FluffelProtocol::pongFrame pong;
+                memcpy(&pong, buffer.data() + pos, sizeof(pong));
+                pos += sizeof(pong);
+
+                std::lock_guard<std::mutex> guard(res.lock);
+                auto it = res.sent.find(pong.id);
+                if (it != res.sent.end()) {
+                    res.latencies.push_back(pong.header.timestamp - it->second);
+                    res.sent.erase(it);
+                }
+                res.lastPong = pong.id;
+                res.transitions = pong.transitions;
+                res.changed.notify_all();
+            }
+            buffer.erase(buffer.begin(), buffer.begin() + pos);
+        }
+
+        std::lock_guard<std::mutex> guard(res.lock);
+        res.closed = true;
+        res.changed.notify_all();
+    }
+
+    bool waitForPong(results &res, uint32_t id) {
+        std::unique_lock<std::mutex> guard(res.lock);
+        return res.changed.wait_for(guard, std::chrono::seconds(5), [&res, id]() {
+            return res.closed || (res.lastPong >= id);
+        }) && !res.closed;
+    }
+
+    double percentile(const std::vector<int64_t> &sorted, double p) {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[index] / 1000.0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = connectTo(opts.socketPath);
+    if (fd == -1) {
+        fprintf(stderr, "Could not connect to %s: %s\n", opts.socketPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    results res;
+    std::thread receiver(receive, fd, std::ref(res));
+
+    /* Select protocol version 2, then get the timers into a known state: running
+     * (after an optional start) with the ingame timer not paused. */
+    std::vector<char> buffer;
+    FluffelProtocol::helloData hello;
+    hello.version = FluffelProtocol::versionCommands;
+    append(buffer, hello);
+
+    uint32_t ping = 1;
+    if (opts.start) {
+        appendFrame(buffer, FluffelProtocol::commandStart, ping++, monotonicNSecs());
+    }
+    appendFrame(buffer, FluffelProtocol::commandResume, ping, monotonicNSecs());
+
+    if (!writeAll(fd, buffer) || !waitForPong(res, ping)) {
+        fprintf(stderr, "Fluffelwatch did not answer. Is it running with protocol version 2 support?\n");
+        shutdown(fd, SHUT_RDWR);
+        receiver.join();
+        close(fd);
+        return 1;
+    }
+
+    uint64_t baseline;
+    {
+        std::lock_guard<std::mutex> guard(res.lock);
+        baseline = res.transitions;
+        res.latencies.clear();
+    }
+
+    /* Send the load: alternating pause and resume, burst by burst */
+    auto interval = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / opts.rate));
+    auto next = std::chrono::steady_clock::now();
+    int64_t begin = monotonicNSecs();
+
+    for (int sent = 0; sent < opts.count; ) {
+        buffer.clear();
+
+        for (int i = 0; (i < opts.burst) && (sent < opts.count); ++i, ++sent) {
+            uint8_t command = (sent % 2 == 0) ? FluffelProtocol::commandPause : FluffelProtocol::commandResume;
+            int64_t now = monotonicNSecs();
+
+            {
+                std::lock_guard<std::mutex> guard(res.lock);
+                res.sent[++ping] = now;
+            }
+            appendFrame(buffer, command, ping, now);
+        }
+
+        if (!writeAll(fd, buffer)) {
+            fprintf(stderr, "Connection lost: %s\n", strerror(errno));
+            break;
+        }
+
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+
+    int64_t duration = monotonicNSecs() - begin;
+
+    /* Make sure the ingame timer runs again and wait for everything to be applied */
+    buffer.clear();
+    appendFrame(buffer, (opts.count % 2 == 1) ? FluffelProtocol::commandResume : 0, ++ping, monotonicNSecs());
+    bool complete = writeAll(fd, buffer) && waitForPong(res, ping);
+
+    shutdown(fd, SHUT_RDWR);
+    receiver.join();
+    close(fd);
+
+    /* Report */
+    std::lock_guard<std::mutex> guard(res.lock);
+    std::vector<int64_t> sorted(res.latencies.begin(), res.latencies.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    uint64_t applied = res.transitions - baseline - ((opts.count % 2 == 1) ? 1 : 0);
+    long long dropped = static_cast<long long>(opts.count) - static_cast<long long>(applied);
+
+    printf("Transitions sent:    %d (%d per burst, %.1f bursts/s)\n", opts.count, opts.burst, opts.rate);
+    printf("Transitions applied: %llu\n", static_cast<unsigned long long>(applied));
+    printf("Dropped transitions: %lld%s\n", dropped, complete ? "" : " (no final answer)");
+    printf("Throughput:          %.1f transitions/s\n", opts.count * 1e9 / duration);
+    printf("Latency (us):        p50 %.1f, p99 %.1f, max %.1f (%zu samples)\n",
+           percentile(sorted, 0.5), percentile(sorted, 0.99), percentile(sorted, 1.0), sorted.size());
+
+    if (applied == 0) {
+        printf("Nothing was applied. Are the timers in Fluffelwatch running?\n");
+    }
+
+    if (!opts.output.empty()) {
+        FILE *file = fopen(opts.output.c_str(), "a");
+        if (file != nullptr) {
+            fprintf(file, "%d,%d,%.1f,%llu,%lld,%.1f,%.1f,%.1f\n", opts.count, opts.burst, opts.rate,
+                    static_cast<unsigned long long>(applied), dropped,
+                    percentile(sorted, 0.5), percentile(sorted, 0.99), percentile(sorted, 1.0));
+            fclose(file);
+        }
+    }
+
+    return (complete && dropped == 0) ? 0 : 2;
+}
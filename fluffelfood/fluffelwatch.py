@@ -28,6 +28,7 @@
 import socket
 import struct
 import sys
+import time
 
 # Default location of the Fluffelwatch socket
 DEFAULT_SOCKET = "/tmp/fluffelwatch"
@@ -41,6 +42,11 @@ CONTROL_ONETIMEONLY = 200   # All control values with this value or higher will
 CONTROL_START = 200         # Both timers should be reset AND started (usually done at the very beginning of a run)
 CONTROL_STOP = 201          # Both timers should be stopped (usually done at the very end of a run)
 
+# Protocol versions; a connection is in legacy mode unless a hello packet is sent first
+HELLO_MAGIC = b"FLW"
+PROTOCOL_LEGACY = 0         # Only the state is sent
+PROTOCOL_TIMESTAMPED = 1    # The state is sent together with the time it changed (CLOCK_MONOTONIC)
+
 # This class encapsulates the logic behind connecting to Fluffelwatch and sending
 # data and the like. Keeps also track of the things sent so you can just simply
 # update the icons without restating section number or control
@@ -53,15 +59,22 @@ class Fluffelwatch:
     __section__ = 0
     __iconstate__ = 0
 
+    # Send timestamps with each state
+    __timestamps__ = False
+
     # Error states
     error = (None, None, None)
 
     # Connecting to Fluffelwatch is relative easy, just open the socket as UNIX-like
-    # stream socket.
-    def connect(self, socketpath: str = DEFAULT_SOCKET) -> bool:
+    # stream socket. With timestamps enabled, each state is sent with the time it was
+    # changed, so Fluffelwatch can pause and split at the exact time.
+    def connect(self, socketpath: str = DEFAULT_SOCKET, timestamps: bool = False) -> bool:
         try:
             self.__sock__ = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
             self.__sock__.connect(socketpath)            
+            self.__timestamps__ = timestamps
+            if timestamps:
+                self.__sock__.sendall(struct.pack("<3sB", HELLO_MAGIC, PROTOCOL_TIMESTAMPED))
         except:
             self.error = sys.exc_info()
             return False
@@ -83,12 +96,18 @@ class Fluffelwatch:
     # 1 Bytes: control timer
     # 4 Bytes: section number
     # 4 Bytes: icon states (bits set for max 32 icons)
-    def send(self, control: int, section: int, iconstate: int) -> None:
+    # 8 Bytes: time of the change in ns (CLOCK_MONOTONIC; only if timestamps are enabled)
+    # The time of the change can be given, otherwise the current time is used.
+    def send(self, control: int, section: int, iconstate: int, timestamp: int = None) -> None:
         self.__control__ = control
         self.__section__ = section
         self.__iconstate__ = iconstate
 
         data = struct.pack("<BII", self.__control__, self.__section__, self.__iconstate__)
+        if self.__timestamps__:
+            if timestamp is None:
+                timestamp = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+            data += struct.pack("<q", timestamp)
         #self.__sock__.sendall(data) 
         # Instead of using the socket functions directly, we create a file object here, write
         # to it in binary mode ("wb"), and flush it - this way, the packages a flushed into
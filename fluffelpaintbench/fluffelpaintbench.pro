@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Fluffelpaintbench: renders frames of the main window offscreen and
+# reports how long painting takes and how much memory it allocates.
+#
+#-------------------------------------------------
+
+TARGET = fluffelpaintbench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../fluffelwatch/fluffelwatch.pri)
+
+SOURCES += \
+    main.cpp
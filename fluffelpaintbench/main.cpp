@@ -0,0 +1,314 @@
+/* Fluffelpaintbench: measures the cost of painting the main window.
+ *
+ * The window is created headless for each settings file (theme) and split
+ * file given and renders frames into an image, with the timers driven by a
+ * virtual clock that advances 10 ms per frame. Every few frames, it splits;
+ * these frames repaint the whole window, all others only what a tick repaints.
+ * For both kinds, the time per frame and the number of allocations (calls to
+ * malloc, calloc and realloc) per frame are reported. Runs without a display
+ * (QT_QPA_PLATFORM=offscreen is set unless another platform is given).
+ *
+ * Optionally, it also writes a history with many attempts into a temporary
+ * directory and reports the time and allocations per appended attempt, the
+ * size per attempt and the time for loading the whole history again. */
+
+#include <QApplication>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fluffelclock.h"
+#include "fluffelhistory.h"
+#include "fluffeltimer.h"
+#include "mainwindow.h"
+
+/* Counting allocations by wrapping the allocator of glibc; this also catches the
+ * allocations within Qt (which uses malloc directly). */
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+
+    static std::atomic<unsigned long long> allocations(0);
+
+    void *malloc(size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+
+namespace {
+    struct options {
+        QStringList configs;
+        QStringList splits;
+        QString output;
+        int frames = 10000;
+        int splitEvery = 100;
+        int attempts = 0;
+        int segments = 30;
+    };
+
+    /* Time (in ns) and allocations of the frames of one kind */
+    struct measurements {
+        QVector<qint64> times;
+        QVector<qint64> allocs;
+    };
+
+    void usage(const char *name) {
+        printf("Usage: %s [options] SETTINGS...\n"
+               "  SETTINGS  settings files to render with (like fluffelwatch.conf)\n"
+               "  -s FILE   split file to render (can be given several times; default:\n"
+               "            the split file of the settings)\n"
+               "  -n COUNT  number of frames (default 10000)\n"
+               "  -k COUNT  split every COUNT frames (default 100)\n"
+               "  -a COUNT  also measure a history of COUNT attempts (default: off)\n"
+               "  -g COUNT  number of segments of these attempts (default 30)\n"
+               "  -o FILE   append the results as CSV lines to FILE\n", name);
+    }
+
+    bool parseOptions(int argc, char *argv[], options &opts) {
+        int c;
+        while ((c = getopt(argc, argv, "s:n:k:a:g:o:h")) != -1) {
+            switch (c) {
+                case 's': opts.splits.append(QString::fromLocal8Bit(optarg)); break;
+                case 'n': opts.frames = atoi(optarg); break;
+                case 'k': opts.splitEvery = atoi(optarg); break;
+                case 'a': opts.attempts = atoi(optarg); break;
+                case 'g': opts.segments = atoi(optarg); break;
+                case 'o': opts.output = QString::fromLocal8Bit(optarg); break;
+                default: return false;
+            }
+        }
+
+        for (int i = optind; i < argc; ++i) {
+            opts.configs.append(QString::fromLocal8Bit(argv[i]));
+        }
+
+        return (!opts.configs.isEmpty() || (opts.attempts > 0)) && (opts.frames > 0) && (opts.splitEvery > 0) &&
+               (opts.attempts >= 0) && (opts.segments > 0);
+    }
+
+    double percentile(QVector<qint64> sorted, double p) {
+        if (sorted.isEmpty()) {
+            return 0.0;
+        }
+
+        std::sort(sorted.begin(), sorted.end());
+        int index = static_cast<int>(p * (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+    double mean(const QVector<qint64> &values) {
+        if (values.isEmpty()) {
+            return 0.0;
+        }
+
+        double sum = 0.0;
+        for (qint64 value : values) {
+            sum += value;
+        }
+
+        return sum / values.size();
+    }
+
+    void report(const QString &name, const QString &kind, const measurements &m, QTextStream *csv, const char *unit = "frame") {
+        printf("  %-6s %6d %ss, us per %s: mean %8.1f, p50 %8.1f, p99 %8.1f, max %8.1f; "
+               "allocations per %s: mean %6.1f, max %4.0f\n",
+               kind.toUtf8().constData(), m.times.size(), unit, unit,
+               mean(m.times) / 1000.0, percentile(m.times, 0.5) / 1000.0,
+               percentile(m.times, 0.99) / 1000.0, percentile(m.times, 1.0) / 1000.0,
+               unit, mean(m.allocs), percentile(m.allocs, 1.0));
+
+        if (csv != nullptr) {
+            *csv << name << ',' << kind << ',' << m.times.size() << ','
+                 << mean(m.times) / 1000.0 << ',' << percentile(m.times, 0.5) / 1000.0 << ','
+                 << percentile(m.times, 0.99) / 1000.0 << ',' << percentile(m.times, 1.0) / 1000.0 << ','
+                 << mean(m.allocs) << ',' << percentile(m.allocs, 1.0) << '\n';
+        }
+    }
+
+    void run(const options &opts, const QString &config, const QString &splits, QTextStream *csv) {
+        FluffelVirtualClock clock(0);
+
+        MainWindow window(nullptr, config, true);
+        window.setClock(&clock);
+
+        QString filename = splits;
+        if (filename.isEmpty()) {
+            filename = QSettings(config, QSettings::NativeFormat).value("Data/segmentData").toString();
+        } else {
+            window.openSplitData(filename);
+        }
+
+        QImage image(window.size(), QImage::Format_ARGB32_Premultiplied);
+
+        /* The first frame builds all caches */
+        window.renderFrame(image, true);
+        window.onSplit();
+
+        measurements ticks;
+        measurements splitFrames;
+        QElapsedTimer timer;
+
+        for (int frame = 1; frame <= opts.frames; ++frame) {
+            clock.advance(10 * FluffelTimer::nsecsPerMSec);
+
+            /* Splitting (and starting over after the last split) is not measured,
+             * only painting the frame afterwards */
+            bool split = (frame % opts.splitEvery == 0);
+            if (split) {
+                window.onSplit();
+
+                if (!window.isRunning()) {
+                    window.openSplitData(filename);
+                    window.onSplit();
+                }
+            }
+
+            unsigned long long before = allocations.load(std::memory_order_relaxed);
+            timer.start();
+
+            window.renderFrame(image, split);
+
+            qint64 time = timer.nsecsElapsed();
+            unsigned long long count = allocations.load(std::memory_order_relaxed) - before;
+
+            measurements &m = split ? splitFrames : ticks;
+            m.times.append(time);
+            m.allocs.append(static_cast<qint64>(count));
+        }
+
+        QString name = config + (splits.isEmpty() ? QString() : " + " + splits);
+        printf("%s (%dx%d)\n", name.toUtf8().constData(), image.width(), image.height());
+        report(name, "tick", ticks, csv);
+        report(name, "split", splitFrames, csv);
+    }
+
+    /* Appends the attempts to a new history one by one, like resetting the timers
+     * does, and loads the history again afterwards */
+    void runHistory(const options &opts, QTextStream *csv) {
+        QTemporaryDir dir;
+        QString filename = dir.filePath("bench.history");
+
+        FluffelHistory history;
+        history.open(filename, opts.segments);
+
+        QVector<qint64> runTimes(opts.segments);
+        QBitArray skipped(opts.segments);
+        qint64 endTime = 1500000000;
+
+        measurements appends;
+        QElapsedTimer timer;
+
+        for (int attempt = 0; attempt < opts.attempts; ++attempt) {
+            /* Segments of about a minute that vary by a few seconds; every fourth
+             * attempt is reset halfway and every tenth skips a segment */
+            int reached = (attempt % 4 == 3) ? opts.segments / 2 : opts.segments;
+            for (int i = 0; i < opts.segments; ++i) {
+                runTimes[i] = (i + 1) * 60000 * FluffelTimer::nsecsPerMSec +
+                              ((attempt * 7919 + i * 104729) % 5000) * FluffelTimer::nsecsPerMSec;
+            }
+
+            skipped.fill(false);
+            if ((attempt % 10 == 9) && (reached > 0)) {
+                skipped.setBit(attempt % reached);
+            }
+
+            endTime += 600;
+
+            unsigned long long before = allocations.load(std::memory_order_relaxed);
+            timer.start();
+
+            history.append(runTimes.constData(), skipped, reached, endTime);
+
+            appends.times.append(timer.nsecsElapsed());
+            appends.allocs.append(static_cast<qint64>(allocations.load(std::memory_order_relaxed) - before));
+        }
+
+        qint64 size = QFile(filename).size();
+
+        FluffelHistory loaded;
+        timer.start();
+        loaded.open(filename, opts.segments);
+        qint64 loadTime = timer.nsecsElapsed();
+
+        QString name = QString("history (%1 segments)").arg(opts.segments);
+        printf("%s: %lld bytes, %.1f bytes per attempt\n", name.toUtf8().constData(),
+               static_cast<long long>(size), static_cast<double>(size) / opts.attempts);
+        report(name, "append", appends, csv, "attempt");
+        printf("  %-6s %6d attempts in %.1f ms\n", "load", loaded.getAttemptCount(), loadTime / 1000000.0);
+
+        if (csv != nullptr) {
+            *csv << name << ",load," << loaded.getAttemptCount() << ',' << loadTime / 1000.0 << '\n';
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    /* Render without a display unless told otherwise */
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The window logs every split; keep the output readable */
+    qputenv("QT_LOGGING_RULES", "default.debug=false");
+
+    QApplication app(argc, argv);
+
+    QFile output(opts.output);
+    QTextStream *csv = nullptr;
+    if (!opts.output.isEmpty()) {
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+            fprintf(stderr, "Could not open %s\n", opts.output.toUtf8().constData());
+            return 1;
+        }
+
+        csv = new QTextStream(&output);
+    }
+
+    QStringList splits = opts.splits;
+    if (splits.isEmpty()) {
+        splits.append(QString());
+    }
+
+    for (const QString &config : opts.configs) {
+        for (const QString &split : splits) {
+            run(opts, config, split, csv);
+        }
+    }
+
+    if (opts.attempts > 0) {
+        runHistory(opts, csv);
+    }
+
+    delete csv;
+    return 0;
+}
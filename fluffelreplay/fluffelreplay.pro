@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Fluffelreplay: plays a capture of the data sent by fluffelfood programs back
+# into Fluffelwatch. Plain C++, only shares the protocol header.
+#
+#-------------------------------------------------
+
+TARGET = fluffelreplay
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../fluffelwatch
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../fluffelwatch/fluffelprotocol.h
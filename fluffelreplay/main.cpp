@@ -0,0 +1,389 @@
+/* Fluffelreplay: plays a capture of Fluffelwatch (see the capture setting in the
+ * [IPC] group) back into its socket, so that the autosplit and pause logic can be
+ * tested without running the game.
+ *
+ * Every client of the capture gets its own connection again and the data is sent
+ * in the same pieces and with the same timing as it arrived, or faster or slower
+ * with a speed factor. Timestamps in the frames (protocol versions 1 and 2) are
+ * moved to the time of the replay, keeping their distance to the arrival time;
+ * everything else (e.g. malformed frames) is sent unchanged. */
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fluffelprotocol.h"
+
+namespace {
+    struct options {
+        std::string socketPath = "/tmp/fluffelwatch";
+        std::string capture;
+        double speed = 1.0;         /* 0 = as fast as possible */
+        int repeat = 1;
+    };
+
+    struct record {
+        FluffelProtocol::captureRecord header;
+        std::vector<char> data;
+
+        /* Position of the data in the stream of its client and the timestamps in
+         * frames that start in this data (also at positions of the stream) */
+        size_t begin = 0;
+        std::vector<size_t> timestamps;
+    };
+
+    /* Everything a client of the capture sent. A client that was already connected
+     * when the capture started needs a hello for its version first. */
+    struct stream {
+        std::vector<char> data;
+        int version = FluffelProtocol::versionLegacy;
+        bool known = false;
+    };
+
+    /* A client of the capture during the replay */
+    struct connection {
+        int fd = -1;
+        std::vector<char> data;
+    };
+
+    int64_t monotonicNSecs() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    void usage(const char *name) {
+        printf("Usage: %s [options] CAPTURE\n"
+               "  -s PATH   socket of Fluffelwatch (default /tmp/fluffelwatch)\n"
+               "  -x SPEED  replay speed, e.g. 10 for ten times faster (default 1, 0 = no waiting)\n"
+               "  -n COUNT  play the capture COUNT times (default 1)\n", name);
+    }
+
+    bool parseOptions(int argc, char *argv[], options &opts) {
+        int c;
+        while ((c = getopt(argc, argv, "s:x:n:h")) != -1) {
+            switch (c) {
+                case 's': opts.socketPath = optarg; break;
+                case 'x': opts.speed = atof(optarg); break;
+                case 'n': opts.repeat = atoi(optarg); break;
+                default: return false;
+            }
+        }
+
+        if (optind != argc - 1) {
+            return false;
+        }
+
+        opts.capture = argv[optind];
+        return (opts.speed >= 0) && (opts.repeat > 0);
+    }
+
+    /* Finds the positions of the timestamps of all frames in a stream, reading it like
+     * Fluffelwatch does. Broken streams are read up to the error. */
+    void findTimestamps(const stream &value, std::vector<size_t> &timestamps) {
+        const std::vector<char> &data = value.data;
+        size_t pos = 0;
+        int version = value.version;
+
+        if (!value.known) {
+            if (data.empty()) {
+                return;
+            }
+
+            version = FluffelProtocol::versionLegacy;
+            if (data[0] == FluffelProtocol::helloMagic[0]) {
+                FluffelProtocol::helloData hello;
+                if (data.size() < sizeof(hello)) {
+                    return;
+                }
+
+                memcpy(&hello, data.data(), sizeof(hello));
+                version = hello.version;
+                pos = sizeof(hello);
+            }
+        }
+
+        while (true) {
+            if (version == FluffelProtocol::versionCommands) {
+                FluffelProtocol::frameHeader header;
+                if ((data.size() - pos < sizeof(header))) {
+                    return;
+                }
+
+                memcpy(&header, data.data() + pos, sizeof(header));
+                if ((header.length > FluffelProtocol::maxFrameLength) || (data.size() - pos - sizeof(header) < header.length)) {
+                    return;
+                }
+
+                timestamps.push_back(pos + offsetof(FluffelProtocol::frameHeader, timestamp));
+                pos += sizeof(header) + header.length;
+            } else if (version == FluffelProtocol::versionTimestamped) {
+                if (data.size() - pos < sizeof(FluffelProtocol::timestampedData)) {
+                    return;
+                }
+
+                timestamps.push_back(pos + offsetof(FluffelProtocol::timestampedData, timestamp));
+                pos += sizeof(FluffelProtocol::timestampedData);
+            } else {
+                return;
+            }
+        }
+    }
+
+    /* Puts the data of each client together and assigns the timestamps to the record
+     * in which they start */
+    void prepareStreams(std::vector<record> &records, std::map<uint32_t, stream> &streams) {
+        for (record &value : records) {
+            if (value.header.event != FluffelProtocol::captureData) {
+                continue;
+            }
+
+            stream &client = streams[value.header.client];
+            if (!client.known && client.data.empty() && (value.header.version != FluffelProtocol::versionLegacy)) {
+                client.version = value.header.version;
+                client.known = true;
+            }
+
+            value.begin = client.data.size();
+            client.data.insert(client.data.end(), value.data.begin(), value.data.end());
+        }
+
+        for (auto &it : streams) {
+            std::vector<size_t> timestamps;
+            findTimestamps(it.second, timestamps);
+
+            size_t next = 0;
+            for (record &value : records) {
+                if ((value.header.event != FluffelProtocol::captureData) || (value.header.client != it.first)) {
+                    continue;
+                }
+
+                while ((next < timestamps.size()) && (timestamps[next] < value.begin + value.data.size())) {
+                    value.timestamps.push_back(timestamps[next++]);
+                }
+            }
+        }
+    }
+
+    bool readCapture(const std::string &filename, std::vector<record> &records) {
+        FILE *file = fopen(filename.c_str(), "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "Could not open %s: %s\n", filename.c_str(), strerror(errno));
+            return false;
+        }
+
+        FluffelProtocol::captureHeader header;
+        if ((fread(&header, sizeof(header), 1, file) != 1) || (header.magic != FluffelProtocol::captureMagic)
+                || (header.version != FluffelProtocol::captureVersion)) {
+            fprintf(stderr, "%s is not a capture of Fluffelwatch.\n", filename.c_str());
+            fclose(file);
+            return false;
+        }
+
+        /* A capture cut off at the end (e.g. by a crash) is played up to there */
+        record value;
+        while (fread(&value.header, sizeof(value.header), 1, file) == 1) {
+            value.data.resize(value.header.length);
+
+            if ((value.header.length > 0) && (fread(value.data.data(), value.header.length, 1, file) != 1)) {
+                break;
+            }
+
+            records.push_back(value);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    int connectTo(const std::string &path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            return -1;
+        }
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    bool writeAll(int fd, const char *data, size_t length) {
+        size_t written = 0;
+        while (written < length) {
+            ssize_t n = send(fd, data + written, length - written, MSG_NOSIGNAL);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += n;
+        }
+
+        return true;
+    }
+
+    /* Moves the timestamp of a frame to the time of the replay. The distance to the
+     * arrival shrinks with the speed like everything else. A timestamp may continue
+     * in the next record, so it is changed in the stream before any of it is sent. */
+    void moveTimestamp(std::vector<char> &data, size_t pos, int64_t arrival, int64_t replayArrival, double speed) {
+        int64_t timestamp;
+        memcpy(&timestamp, data.data() + pos, sizeof(timestamp));
+        if (timestamp == 0) {
+            return;
+        }
+
+        int64_t distance = (speed > 0) ? static_cast<int64_t>((arrival - timestamp) / speed) : 0;
+        timestamp = std::min(replayArrival - distance, monotonicNSecs());
+
+        memcpy(data.data() + pos, &timestamp, sizeof(timestamp));
+    }
+
+    void closeAll(std::map<uint32_t, connection> &connections) {
+        for (auto &it : connections) {
+            if (it.second.fd != -1) {
+                close(it.second.fd);
+            }
+        }
+
+        connections.clear();
+    }
+
+    /* Plays all records once; returns the number of pieces of data sent or -1 on errors */
+    long replay(const options &opts, const std::vector<record> &records, const std::map<uint32_t, stream> &streams) {
+        std::map<uint32_t, connection> connections;
+        long chunks = 0;
+
+        int64_t captureStart = records.front().header.arrival;
+        int64_t replayStart = monotonicNSecs();
+
+        for (const record &value : records) {
+            /* Wait until it is time for this record */
+            int64_t replayArrival = replayStart;
+            if (opts.speed > 0) {
+                replayArrival += static_cast<int64_t>((value.header.arrival - captureStart) / opts.speed);
+
+                int64_t wait = replayArrival - monotonicNSecs();
+                if (wait > 0) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+            } else {
+                replayArrival = monotonicNSecs();
+            }
+
+            connection &client = connections[value.header.client];
+
+            if (value.header.event == FluffelProtocol::captureDisconnect) {
+                if (client.fd != -1) {
+                    close(client.fd);
+                }
+                connections.erase(value.header.client);
+                continue;
+            }
+
+            /* Captures started while clients were connected have no connect record for them */
+            if (client.fd == -1) {
+                client.fd = connectTo(opts.socketPath);
+                if (client.fd == -1) {
+                    fprintf(stderr, "Could not connect to %s: %s\n", opts.socketPath.c_str(), strerror(errno));
+                    closeAll(connections);
+                    return -1;
+                }
+
+                /* Such a client also selected its protocol version before */
+                auto it = streams.find(value.header.client);
+                if (it != streams.end()) {
+                    client.data = it->second.data;
+
+                    if (it->second.known) {
+                        FluffelProtocol::helloData hello;
+                        hello.version = it->second.version;
+
+                        if (!writeAll(client.fd, reinterpret_cast<const char*>(&hello), sizeof(hello))) {
+                            fprintf(stderr, "Connection lost: %s\n", strerror(errno));
+                            closeAll(connections);
+                            return -1;
+                        }
+                    }
+                }
+            }
+
+            if (value.header.event != FluffelProtocol::captureData) {
+                continue;
+            }
+
+            for (size_t pos : value.timestamps) {
+                moveTimestamp(client.data, pos, value.header.arrival, replayArrival, opts.speed);
+            }
+
+            if (!writeAll(client.fd, client.data.data() + value.begin, value.data.size())) {
+                fprintf(stderr, "Connection lost: %s\n", strerror(errno));
+                closeAll(connections);
+                return -1;
+            }
+
+            chunks++;
+        }
+
+        closeAll(connections);
+        return chunks;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<record> records;
+    if (!readCapture(opts.capture, records)) {
+        return 1;
+    }
+
+    std::map<uint32_t, stream> streams;
+    prepareStreams(records, streams);
+
+    if (records.empty()) {
+        printf("The capture is empty.\n");
+        return 0;
+    }
+
+    double duration = (records.back().header.arrival - records.front().header.arrival) / 1e9;
+    printf("Playing %zu records (%.1f s captured) at speed %g.\n", records.size(), duration, opts.speed);
+
+    for (int i = 0; i < opts.repeat; ++i) {
+        int64_t start = monotonicNSecs();
+        long chunks = replay(opts, records, streams);
+        if (chunks < 0) {
+            return 1;
+        }
+
+        printf("Run %d: %ld pieces of data in %.3f s\n", i + 1, chunks, (monotonicNSecs() - start) / 1e9);
+    }
+
+    return 0;
+}
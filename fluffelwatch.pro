@@ -0,0 +1,9 @@
+# Builds Fluffelwatch together with its tools
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    fluffelwatch \
+    fluffelbench \
+    fluffelpaintbench \
+    fluffelreplay \
+    libfluffelfood
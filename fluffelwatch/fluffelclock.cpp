@@ -0,0 +1,58 @@
+#include "fluffelclock.h"
+
+#include <time.h>
+
+FluffelClock::~FluffelClock() {
+
+}
+
+FluffelClock* FluffelClock::monotonic() {
+    static FluffelMonotonicClock clock;
+    return &clock;
+}
+
+qint64 FluffelMonotonicClock::nsecs() const {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+FluffelVirtualClock::FluffelVirtualClock(qint64 start) {
+    now = start;
+}
+
+qint64 FluffelVirtualClock::nsecs() const {
+    return now;
+}
+
+void FluffelVirtualClock::setTime(qint64 time) {
+    now = time;
+}
+
+void FluffelVirtualClock::advance(qint64 time) {
+    now += time;
+}
+
+FluffelScaledClock::FluffelScaledClock(double factor, FluffelClock* base) {
+    this->base = base;
+    this->factor = factor;
+
+    baseOrigin = base->nsecs();
+    origin = baseOrigin;
+}
+
+qint64 FluffelScaledClock::nsecs() const {
+    return origin + static_cast<qint64>((base->nsecs() - baseOrigin) * factor);
+}
+
+void FluffelScaledClock::setFactor(double value) {
+    /* Continue from the current time with the new speed */
+    origin = nsecs();
+    baseOrigin = base->nsecs();
+    factor = value;
+}
+
+double FluffelScaledClock::getFactor() const {
+    return factor;
+}
@@ -0,0 +1,62 @@
+#ifndef FLUFFELCLOCK_H
+#define FLUFFELCLOCK_H
+
+#include <QtGlobal>
+
+/* Source of the time for FluffelTimer and TimeController. Usually this is the
+ * monotonic system clock, but a virtual clock allows to run through a whole run
+ * in no time (e.g. for benchmarks and tests) and a scaled clock lets the time
+ * pass faster or slower (e.g. when replaying). All times are in ns. */
+class FluffelClock {
+  public:
+    virtual ~FluffelClock();
+
+    /* The current time of this clock */
+    virtual qint64 nsecs() const = 0;
+
+    /* The monotonic system clock (CLOCK_MONOTONIC), shared by everyone */
+    static FluffelClock *monotonic();
+};
+
+/* The monotonic system clock; use FluffelClock::monotonic() to get it */
+class FluffelMonotonicClock : public FluffelClock {
+  public:
+    qint64 nsecs() const override;
+};
+
+/* A clock that only moves when told to */
+class FluffelVirtualClock : public FluffelClock {
+  public:
+    explicit FluffelVirtualClock(qint64 start = 0);
+
+    qint64 nsecs() const override;
+
+    void setTime(qint64 time);
+    void advance(qint64 time);
+
+  private:
+    qint64 now;
+};
+
+/* A clock that runs factor times as fast as another clock (from the time it was
+ * created or the factor was changed) */
+class FluffelScaledClock : public FluffelClock {
+  public:
+    explicit FluffelScaledClock(double factor, FluffelClock *base = FluffelClock::monotonic());
+
+    qint64 nsecs() const override;
+
+    /* Changes the speed from now on; the time does not jump */
+    void setFactor(double value);
+    double getFactor() const;
+
+  private:
+    FluffelClock *base;
+    double factor;
+
+    /* Time of both clocks when the factor was set */
+    qint64 baseOrigin;
+    qint64 origin;
+};
+
+#endif // FLUFFELCLOCK_H
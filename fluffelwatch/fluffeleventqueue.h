@@ -0,0 +1,65 @@
+#ifndef FLUFFELEVENTQUEUE_H
+#define FLUFFELEVENTQUEUE_H
+
+#include <QAtomicInteger>
+
+/* Lock-free ring buffer for exactly one producer thread and exactly one
+ * consumer thread. Size has to be a power of two. The read and write
+ * positions are free-running counters, so the buffer can use all of its
+ * slots. */
+template <typename T, quint32 Size>
+class FluffelEventQueue {
+    static_assert((Size & (Size - 1)) == 0, "Size of FluffelEventQueue has to be a power of two");
+
+  public:
+    FluffelEventQueue() : readPos(0), writePos(0), overflows(0) {}
+
+    /* Producer side: adds a copy of value to the queue. Returns false (and counts
+     * an overflow) if the queue is full. */
+    bool push(const T& value) {
+        quint32 write = writePos.loadAcquire();
+
+        if (write - readPos.loadAcquire() >= Size) {
+            overflows.fetchAndAddRelaxed(1);
+            return false;
+        }
+
+        buffer[write & (Size - 1)] = value;
+        writePos.storeRelease(write + 1);
+        return true;
+    }
+
+    /* Consumer side: takes the oldest element from the queue. Returns false if
+     * the queue is empty. */
+    bool pop(T& value) {
+        quint32 read = readPos.loadAcquire();
+
+        if (read == writePos.loadAcquire()) {
+            return false;
+        }
+
+        value = buffer[read & (Size - 1)];
+
+        /* Release the slot; clear it first so that implicitly shared data is freed by the consumer */
+        buffer[read & (Size - 1)] = T();
+        readPos.storeRelease(read + 1);
+        return true;
+    }
+
+    /* These can be called from both sides; the results are only snapshots */
+    bool isEmpty() const { return readPos.loadAcquire() == writePos.loadAcquire(); }
+    quint32 count() const { return writePos.loadAcquire() - readPos.loadAcquire(); }
+    quint64 getOverflows() const { return overflows.loadAcquire(); }
+
+  private:
+    T buffer[Size];
+
+    /* Only the consumer writes readPos and only the producer writes writePos */
+    QAtomicInteger<quint32> readPos;
+    QAtomicInteger<quint32> writePos;
+
+    /* Number of times push was called on a full queue */
+    QAtomicInteger<quint64> overflows;
+};
+
+#endif // FLUFFELEVENTQUEUE_H
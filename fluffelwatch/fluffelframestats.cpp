@@ -0,0 +1,98 @@
+#include "fluffelframestats.h"
+
+/* 100 us buckets up to 50 ms; everything longer ends up in the last bucket */
+const qint64 FluffelFrameStats::bucketSize = 100000;
+const int FluffelFrameStats::bucketCount = 501;
+
+const char *FluffelFrameStats::names[measureCount] = { "tick interval", "repaint latency", "paint duration" };
+
+FluffelFrameStats::FluffelFrameStats() {
+    clear();
+}
+
+FluffelFrameStats::~FluffelFrameStats() {
+
+}
+
+void FluffelFrameStats::add(FluffelFrameStats::measure type, qint64 time) {
+    histogramData &data = histograms[type];
+
+    int bucket = qBound(0, static_cast<int>(time / bucketSize), bucketCount - 1);
+    data.buckets[bucket]++;
+
+    data.count++;
+    data.sum += time;
+    data.max = qMax(data.max, time);
+}
+
+void FluffelFrameStats::clear() {
+    for (int i = 0; i < measureCount; ++i) {
+        histograms[i].buckets.fill(0, bucketCount);
+        histograms[i].count = 0;
+        histograms[i].sum = 0;
+        histograms[i].max = 0;
+    }
+}
+
+quint64 FluffelFrameStats::getCount(FluffelFrameStats::measure type) const {
+    return histograms[type].count;
+}
+
+qint64 FluffelFrameStats::getPercentile(FluffelFrameStats::measure type, double p) const {
+    const histogramData &data = histograms[type];
+
+    if (data.count == 0) {
+        return 0;
+    }
+
+    /* Find the bucket with the sample at this rank; the last bucket has no upper bound */
+    quint64 rank = qMax(Q_UINT64_C(1), static_cast<quint64>(p * data.count + 0.5));
+    quint64 seen = 0;
+
+    for (int i = 0; i < bucketCount - 1; ++i) {
+        seen += data.buckets[i];
+        if (seen >= rank) {
+            return qMin((i + 1) * bucketSize, data.max);
+        }
+    }
+
+    return data.max;
+}
+
+qint64 FluffelFrameStats::getMean(FluffelFrameStats::measure type) const {
+    const histogramData &data = histograms[type];
+    return (data.count > 0) ? data.sum / static_cast<qint64>(data.count) : 0;
+}
+
+qint64 FluffelFrameStats::getMax(FluffelFrameStats::measure type) const {
+    return histograms[type].max;
+}
+
+QStringList FluffelFrameStats::summary() const {
+    QStringList lines;
+
+    for (int i = 0; i < measureCount; ++i) {
+        measure type = static_cast<measure>(i);
+
+        lines.append(QString::asprintf("%-15s %7llu, mean %6.2f, p50 %6.2f, p99 %6.2f, max %6.2f ms",
+                                       names[i], static_cast<unsigned long long>(getCount(type)),
+                                       getMean(type) / 1e6, getPercentile(type, 0.5) / 1e6,
+                                       getPercentile(type, 0.99) / 1e6, getMax(type) / 1e6));
+    }
+
+    return lines;
+}
+
+QString FluffelFrameStats::histogram(FluffelFrameStats::measure type) const {
+    const histogramData &data = histograms[type];
+    QStringList buckets;
+
+    for (int i = 0; i < bucketCount; ++i) {
+        if (data.buckets[i] > 0) {
+            QString bound = (i < bucketCount - 1) ? QString::number((i + 1) * bucketSize / 1000) : QString("inf");
+            buckets.append(bound + ": " + QString::number(data.buckets[i]));
+        }
+    }
+
+    return QString(names[type]) + " [us] " + buckets.join(", ");
+}
@@ -0,0 +1,51 @@
+#ifndef FLUFFELFRAMESTATS_H
+#define FLUFFELFRAMESTATS_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/* Histograms of the frame timing of the main window: the interval between
+ * ticks, the latency from a tick requesting a repaint until the painting
+ * starts and the duration of the painting. A stalled GUI thread (e.g. by a
+ * dialog or saving a file) shows up as long intervals and latencies. All
+ * times are in ns, the histograms have buckets of bucketSize. */
+class FluffelFrameStats {
+  public:
+    FluffelFrameStats();
+    ~FluffelFrameStats();
+
+    enum measure { tickInterval = 0, repaintLatency = 1, paintDuration = 2, measureCount = 3 };
+
+    static const qint64 bucketSize;
+    static const int bucketCount;
+
+    void add(measure type, qint64 time);
+    void clear();
+
+    /* The percentile is the upper bound of the bucket it lies in */
+    quint64 getCount(measure type) const;
+    qint64 getPercentile(measure type, double p) const;
+    qint64 getMean(measure type) const;
+    qint64 getMax(measure type) const;
+
+    /* One line per measure with count, mean, p50, p99 and max */
+    QStringList summary() const;
+
+    /* Non-empty buckets as "upper bound in us: count" */
+    QString histogram(measure type) const;
+
+  private:
+    struct histogramData {
+        QVector<quint64> buckets;
+        quint64 count = 0;
+        qint64 sum = 0;
+        qint64 max = 0;
+    };
+
+    histogramData histograms[measureCount];
+
+    static const char *names[measureCount];
+};
+
+#endif // FLUFFELFRAMESTATS_H
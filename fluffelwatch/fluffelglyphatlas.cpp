@@ -0,0 +1,101 @@
+#include "fluffelglyphatlas.h"
+
+#include <QFontMetrics>
+
+const QString FluffelGlyphAtlas::characters = QString("0123456789:.+-") + QChar(0x2212);
+
+FluffelGlyphAtlas::FluffelGlyphAtlas() {
+
+}
+
+FluffelGlyphAtlas::~FluffelGlyphAtlas() {
+
+}
+
+void FluffelGlyphAtlas::build(const QFont& font, const QColor& color, qreal ratio) {
+    this->font = font;
+    this->color = color;
+    this->ratio = ratio;
+
+    /* Place all glyphs next to each other with their advance as width */
+    QFontMetrics fm(font);
+    height = fm.height();
+
+    offsets.resize(characters.size());
+    widths.resize(characters.size());
+
+    int width = 0;
+    for (int i = 0; i < characters.size(); ++i) {
+        offsets[i] = width;
+        widths[i] = fm.size(Qt::TextSingleLine, QString(characters[i])).width();
+        width += widths[i];
+    }
+
+    /* Render them in the resolution of the screen, so they are copied 1:1 */
+    atlas = QPixmap(QSize(width, height) * ratio);
+    atlas.setDevicePixelRatio(ratio);
+    atlas.fill(Qt::transparent);
+
+    QPainter painter(&atlas);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.setFont(font);
+    painter.setPen(color);
+
+    for (int i = 0; i < characters.size(); ++i) {
+        painter.drawText(QRect(offsets[i], 0, widths[i], height), Qt::AlignLeft | Qt::AlignVCenter, QString(characters[i]));
+    }
+}
+
+bool FluffelGlyphAtlas::matches(const QFont& font, const QColor& color, qreal ratio) const {
+    return (this->ratio == ratio) && (this->color == color) && (this->font == font);
+}
+
+bool FluffelGlyphAtlas::draw(QPainter& painter, const QRect& rect, const QString& text, int flags) const {
+    /* Measure the text first; this also checks that all glyphs are there */
+    int width = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        int index = glyphIndex(text[i]);
+        if (index == -1) {
+            return false;
+        }
+
+        width += widths[index];
+    }
+
+    int x = rect.left();
+    if (flags & Qt::AlignRight) {
+        x = rect.right() + 1 - width;
+    } else if (flags & Qt::AlignHCenter) {
+        x = rect.left() + (rect.width() - width) / 2;
+    }
+
+    int y = rect.top() + (rect.height() - height) / 2;
+
+    for (int i = 0; i < text.size(); ++i) {
+        int index = glyphIndex(text[i]);
+
+        painter.drawPixmap(QPoint(x, y), atlas, QRect(QPoint(offsets[index], 0) * ratio, QSize(widths[index], height) * ratio));
+        x += widths[index];
+    }
+
+    return true;
+}
+
+int FluffelGlyphAtlas::glyphIndex(QChar c) {
+    /* Same order as in characters */
+    ushort code = c.unicode();
+
+    if ((code >= '0') && (code <= '9')) {
+        return code - '0';
+    }
+
+    switch (code) {
+        case ':': return 10;
+        case '.': return 11;
+        case '+': return 12;
+        case '-': return 13;
+        case 0x2212: return 14;
+    }
+
+    return -1;
+}
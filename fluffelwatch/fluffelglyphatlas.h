@@ -0,0 +1,47 @@
+#ifndef FLUFFELGLYPHATLAS_H
+#define FLUFFELGLYPHATLAS_H
+
+#include <QColor>
+#include <QFont>
+#include <QPainter>
+#include <QPixmap>
+#include <QString>
+#include <QVector>
+
+/* Pre-rendered glyphs of one font and color for drawing times, which only consist
+ * of digits, ':', '.' and signs. All glyphs are rendered once into a pixmap and
+ * times are drawn by copying glyph after glyph, so no text layout or shaping is
+ * done for them on each frame. */
+class FluffelGlyphAtlas {
+  public:
+    FluffelGlyphAtlas();
+    ~FluffelGlyphAtlas();
+
+    /* Renders the glyphs for the given font and color at the given device pixel ratio */
+    void build(const QFont &font, const QColor &color, qreal ratio);
+    bool matches(const QFont &font, const QColor &color, qreal ratio) const;
+
+    /* Draws the text aligned in the rectangle (horizontal alignment and vertical
+     * centering as with QPainter::drawText). Returns false without drawing anything
+     * if the text has characters not in the atlas. */
+    bool draw(QPainter &painter, const QRect &rect, const QString &text, int flags) const;
+
+  private:
+    /* Characters in the atlas; the minus is a real minus (U+2212) */
+    static const QString characters;
+
+    QFont font;
+    QColor color;
+    qreal ratio = 0.0;
+
+    QPixmap atlas;
+    int height = 0;
+
+    /* Position and width of each character in the atlas (in logical pixels) */
+    QVector<int> offsets;
+    QVector<int> widths;
+
+    static int glyphIndex(QChar c);
+};
+
+#endif // FLUFFELGLYPHATLAS_H
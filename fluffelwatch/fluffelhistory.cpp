@@ -0,0 +1,320 @@
+#include "fluffelhistory.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <string.h>
+
+const qint64 FluffelHistory::noTime = -1;
+
+FluffelHistory::FluffelHistory() {
+
+}
+
+FluffelHistory::~FluffelHistory() {
+
+}
+
+QString FluffelHistory::filenameOf(const QString& splitFilename) {
+    QFileInfo info(splitFilename);
+    return info.dir().filePath(info.completeBaseName() + ".history");
+}
+
+bool FluffelHistory::open(const QString& filename, int segments) {
+    close();
+
+    this->filename = filename;
+    this->segments = segments;
+    lastTimes.resize(segments);
+
+    /* Without a file, the history starts with the first attempt */
+    QFile file(filename);
+    if (!file.exists()) {
+        opened = true;
+        return true;
+    }
+
+    if (!file.open(QIODevice::ReadWrite)) {
+        qDebug("Could not open history %s.", filename.toStdString().c_str());
+        return false;
+    }
+
+    /* Only a part of the header means that the history was never written */
+    qint64 size = file.size();
+    if (size < static_cast<qint64>(sizeof(fileHeader))) {
+        file.resize(0);
+        opened = true;
+        return true;
+    }
+
+    uchar *data = file.map(0, size);
+    if (data == nullptr) {
+        qDebug("Could not map history %s.", filename.toStdString().c_str());
+        return false;
+    }
+
+    fileHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if ((memcmp(header.magic, fileHeader().magic, sizeof(header.magic)) != 0) || (header.version != fileHeader().version)) {
+        qDebug("%s is not a history of Fluffelwatch.", filename.toStdString().c_str());
+        file.unmap(data);
+        return false;
+    }
+
+    if (header.segments != static_cast<quint32>(segments)) {
+        qDebug("History %s has %u segments, but the split data %d; no attempts are added to it.",
+               filename.toStdString().c_str(), header.segments, segments);
+        file.unmap(data);
+        return false;
+    }
+
+    qint64 valid = 0;
+    decode(data + sizeof(header), size - sizeof(header), valid);
+    file.unmap(data);
+
+    /* New attempts are appended after the last complete one */
+    if (static_cast<qint64>(sizeof(header)) + valid < size) {
+        qDebug("Cutting off %lld bytes of an incomplete attempt.", static_cast<long long>(size - sizeof(header) - valid));
+        file.resize(sizeof(header) + valid);
+    }
+
+    opened = true;
+    qDebug("Loaded %d attempts from history %s", attempts, filename.toStdString().c_str());
+    return true;
+}
+
+void FluffelHistory::close() {
+    opened = false;
+    segments = 0;
+    attempts = 0;
+    capacity = 0;
+    times.clear();
+    endTimes.clear();
+    lastTimes.clear();
+    lastEndTime = 0;
+}
+
+bool FluffelHistory::isOpen() const {
+    return opened;
+}
+
+QString FluffelHistory::getFilename() const {
+    return filename;
+}
+
+bool FluffelHistory::append(const qint64* runTimes, const QBitArray& skipped, int reached, qint64 endTime) {
+    if (!opened || (reached > segments)) {
+        return false;
+    }
+
+    /* Encode the attempt (see the header) */
+    QByteArray record;
+    writeVarint(record, zigzag(endTime - lastEndTime));
+    writeVarint(record, reached);
+
+    QByteArray bits((reached + 7) / 8, 0);
+    for (int i = 0; i < reached; ++i) {
+        if (skipped.testBit(i)) {
+            bits[i / 8] = static_cast<char>(bits.at(i / 8) | (1 << (i % 8)));
+        }
+    }
+    record.append(bits);
+
+    for (int i = 0; i < reached; ++i) {
+        if (!skipped.testBit(i)) {
+            writeVarint(record, zigzag(runTimes[i] - lastTimes[i]));
+        }
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug("Could not open history %s.", filename.toStdString().c_str());
+        return false;
+    }
+
+    QByteArray out;
+    if (file.size() == 0) {
+        fileHeader header;
+        header.segments = segments;
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    writeVarint(out, record.size());
+    out.append(record);
+
+    if (file.write(out) != out.size()) {
+        qDebug("Could not write to history %s.", filename.toStdString().c_str());
+        return false;
+    }
+
+    /* And the same in memory */
+    reserve(attempts + 1);
+
+    for (int i = 0; i < segments; ++i) {
+        qint64 time = noTime;
+        if ((i < reached) && !skipped.testBit(i)) {
+            time = lastTimes[i] = runTimes[i];
+        }
+
+        times[i * capacity + attempts] = time;
+    }
+
+    endTimes.append(endTime);
+    lastEndTime = endTime;
+    attempts++;
+
+    return true;
+}
+
+int FluffelHistory::getAttemptCount() const {
+    return attempts;
+}
+
+int FluffelHistory::getSegmentCount() const {
+    return segments;
+}
+
+const qint64* FluffelHistory::getSegmentTimes(int segment) const {
+    return times.data() + segment * capacity;
+}
+
+qint64 FluffelHistory::getEndTime(int attempt) const {
+    return endTimes[attempt];
+}
+
+void FluffelHistory::reserve(int count) {
+    if (count <= capacity) {
+        return;
+    }
+
+    /* The columns move to their new places from the last one, so none overwrites
+     * another one that has not moved yet */
+    int newCapacity = qMax(qMax(count, capacity * 2), 64);
+    times.resize(segments * newCapacity);
+
+    for (int i = segments - 1; i > 0; --i) {
+        memmove(times.data() + i * newCapacity, times.data() + i * capacity, attempts * sizeof(qint64));
+    }
+
+    capacity = newCapacity;
+}
+
+bool FluffelHistory::decode(const uchar* data, qint64 size, qint64& valid) {
+    const uchar *end = data + size;
+    const uchar *position = data;
+
+    /* Count the complete records first, so the columns are only allocated once */
+    int count = 0;
+    while (position < end) {
+        quint64 length = 0;
+        if (!readVarint(position, end, length) || (length > static_cast<quint64>(end - position))) {
+            break;
+        }
+
+        position += length;
+        count++;
+    }
+
+    reserve(count);
+    endTimes.resize(count);
+
+    /* Write the differences into the columns; segments without a time get 0 there,
+     * so the prefix sums below carry the last time over them */
+    QBitArray missing(segments * count);
+    position = data;
+
+    for (int attempt = 0; attempt < count; ++attempt) {
+        quint64 length = 0;
+        readVarint(position, end, length);
+
+        const uchar *recordEnd = position + length;
+        quint64 value = 0;
+        quint64 reached = 0;
+
+        bool complete = readVarint(position, recordEnd, value) && readVarint(position, recordEnd, reached) &&
+                        (reached <= static_cast<quint64>(segments)) &&
+                        (static_cast<quint64>(recordEnd - position) >= (reached + 7) / 8);
+
+        if (complete) {
+            endTimes[attempt] = lastEndTime + unzigzag(value);
+
+            const uchar *bits = position;
+            position += (reached + 7) / 8;
+
+            for (int i = 0; complete && (i < segments); ++i) {
+                qint64 *column = times.data() + i * capacity;
+
+                if ((static_cast<quint64>(i) < reached) && !(bits[i / 8] & (1 << (i % 8)))) {
+                    complete = readVarint(position, recordEnd, value);
+                    column[attempt] = unzigzag(value);
+                } else {
+                    column[attempt] = 0;
+                    missing.setBit(attempt * segments + i);
+                }
+            }
+        }
+
+        /* A damaged record ends the history */
+        if (!complete) {
+            qDebug("Attempt %d of the history is damaged.", attempt + 1);
+            count = attempt;
+            endTimes.resize(count);
+            break;
+        }
+
+        lastEndTime = endTimes[attempt];
+        position = recordEnd;
+        valid = position - data;
+    }
+
+    /* Decode the differences of each segment and mark the missing times */
+    for (int i = 0; i < segments; ++i) {
+        qint64 *column = times.data() + i * capacity;
+        lastTimes[i] = FluffelTimeColumn::prefixSum(column, column, count);
+
+        for (int attempt = 0; attempt < count; ++attempt) {
+            if (missing.testBit(attempt * segments + i)) {
+                column[attempt] = noTime;
+            }
+        }
+    }
+
+    attempts = count;
+    return valid == size;
+}
+
+void FluffelHistory::writeVarint(QByteArray& out, quint64 value) {
+    /* Seven bits per byte, the highest bit is set if another byte follows */
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+
+    out.append(static_cast<char>(value));
+}
+
+bool FluffelHistory::readVarint(const uchar*& data, const uchar* end, quint64& value) {
+    value = 0;
+
+    for (int shift = 0; (shift < 64) && (data < end); shift += 7) {
+        uchar byte = *data++;
+        value |= static_cast<quint64>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+quint64 FluffelHistory::zigzag(qint64 value) {
+    /* Small negative values become small positive ones: 0, -1, 1, -2 -> 0, 1, 2, 3 */
+    return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+}
+
+qint64 FluffelHistory::unzigzag(quint64 value) {
+    return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+}
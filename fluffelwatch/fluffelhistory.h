@@ -0,0 +1,95 @@
+#ifndef FLUFFELHISTORY_H
+#define FLUFFELHISTORY_H
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QString>
+
+#include "fluffeltimecolumn.h"
+
+/* History of all attempts of a split file, stored next to it (run.conf has the
+ * history run.history). The file is only appended to: an attempt is added as one
+ * record at the end, so adding one costs O(segments) however long the history is.
+ *
+ * The times are encoded per segment: each time is stored as the difference to
+ * the last time of the same segment in the history, zigzag and varint encoded
+ * (see below). Times of a segment differ by a few seconds between attempts, so
+ * most take four or five bytes instead of eight.
+ *
+ * The file is read through a memory map and decoded into one column per segment
+ * with one time per attempt (noTime for skipped or not reached segments). The
+ * differences are decoded with a prefix sum over each column. */
+class FluffelHistory {
+  public:
+    FluffelHistory();
+    ~FluffelHistory();
+
+    /* File header; the segment count must match the split file */
+#pragma pack(push, 1)
+    struct fileHeader {
+        char magic[4] = { 'F', 'W', 'H', 'I' };
+        quint8 version = 1;
+        quint8 reserved[3] = { 0, 0, 0 };
+        quint32 segments = 0;
+    };
+#pragma pack(pop)
+
+    /* Each attempt after the header is:
+     *   varint     length of the rest of the record
+     *   zigzag     end of the attempt (real time in s) minus the one of the attempt before
+     *   varint     number of segments reached (split or skipped)
+     *   bytes      skipped segments as bits, (reached + 7) / 8 bytes
+     *   zigzag     for each reached and not skipped segment, its time in ns minus the
+     *              last time of this segment in the history (0 if there is none) */
+
+    static const qint64 noTime;
+
+    /* File name of the history of a split file */
+    static QString filenameOf(const QString &splitFilename);
+
+    /* Opens the history and reads all attempts. A missing file is an empty history.
+     * A record that was only written partially (crash while writing) is cut off.
+     * Returns false if the history cannot be used, e.g. if it belongs to a split
+     * file with another number of segments. */
+    bool open(const QString &filename, int segments);
+    void close();
+    bool isOpen() const;
+    QString getFilename() const;
+
+    /* Appends an attempt that reached the given number of segments. runTimes has the
+     * times of these segments (in ns); those of skipped segments are ignored. The
+     * end time is the real time in s. */
+    bool append(const qint64 *runTimes, const QBitArray &skipped, int reached, qint64 endTime);
+
+    int getAttemptCount() const;
+    int getSegmentCount() const;
+
+    /* Times of a segment, one per attempt, and the end time of the attempts */
+    const qint64 *getSegmentTimes(int segment) const;
+    qint64 getEndTime(int attempt) const;
+
+  private:
+    QString filename;
+    bool opened = false;
+    int segments = 0;
+    int attempts = 0;
+
+    /* All segment columns in one array; each column has room for capacity times */
+    FluffelTimeColumn times;
+    int capacity = 0;
+    FluffelTimeColumn endTimes;
+
+    /* Last time of each segment and the last end time; the base of the differences */
+    FluffelTimeColumn lastTimes;
+    qint64 lastEndTime = 0;
+
+    void reserve(int count);
+    bool decode(const uchar *data, qint64 size, qint64 &valid);
+
+    static void writeVarint(QByteArray &out, quint64 value);
+    static bool readVarint(const uchar *&data, const uchar *end, quint64 &value);
+    static quint64 zigzag(qint64 value);
+    static qint64 unzigzag(quint64 value);
+};
+
+#endif // FLUFFELHISTORY_H
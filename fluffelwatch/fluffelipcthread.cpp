@@ -1,16 +1,22 @@
 #include "fluffelipcthread.h"
-
-/* Timeout for the blocking waiting-for-connection function (in ms) */
-const int FluffelIPCThread::timeout = 400;
+#include "fluffeltimer.h"
 
 /* Server name for the socket */
 const QString FluffelIPCThread::listenerName = "fluffelwatch";
 
+/* Clients send their events right away, a second is plenty for any delay on the way */
+const qint64 FluffelIPCThread::maxEventAge = Q_INT64_C(1000000000);
+
+/* Interval for moving waiting events into a full event queue (in ms) */
+const int FluffelIPCThread::backlogRetryInterval = 1;
+
 
 FluffelIPCThread::FluffelIPCThread() {
     server = nullptr;
-    client = nullptr;
-    changed = false;
+    notified = 0;
+    statBytes = 0;
+    statFrames = 0;
+    statMalformed = 0;
 
     /* Give this thread a good name to be able to find it in process overviews (ps and the like) */
     setObjectName("fluffelwatch socket thread");
@@ -22,88 +28,137 @@ FluffelIPCThread::~FluffelIPCThread() {
 void FluffelIPCThread::run() {
     /* Nothing connected */
     server = nullptr;
-    client = nullptr;
-    changed = false;
-    internalData = listenerData();
+    clients.clear();
+    merger.clear();
+    lastData = listenerData();
+    backlog.clear();
+
+    /* Timer for delivering the backlog; lives in this thread */
+    backlogTimer = new QTimer();
+    backlogTimer->setInterval(backlogRetryInterval);
+    connect(backlogTimer, &QTimer::timeout, this, &FluffelIPCThread::flushBacklog, Qt::DirectConnection);
 
     if (!openListener()) {
         qDebug("Socket could not be opened. Aborting thread.");
+        delete backlogTimer;
+        backlogTimer = nullptr;
         return;
     }
 
-    /* Main loop for this thread */
-    while(!isInterruptionRequested()) {
-        /* If there is no client connected, then we will wait simply for one */
-        if (client == nullptr) {
-            /* Wait for connection (or timeout); this will also reduce the CPU load */
-            server->waitForNewConnection(timeout);
-
-            /* Client connected? Will return nullptr if no client is there */
-            client = server->nextPendingConnection();
-
-            /* This will refuse all remaining connections */
-            if (client != nullptr) {
-                server->close();
-            }
-
-            continue;
+    /* The capture is written by this thread only */
+    if (!captureFilename.isEmpty()) {
+        captureFile = new QFile(captureFilename);
+
+        if (captureFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            FluffelProtocol::captureHeader header;
+            captureFile->write(reinterpret_cast<const char*>(&header), sizeof(header));
+            qDebug("Capturing all client data to '%s'.", captureFilename.toStdString().c_str());
+        } else {
+            qDebug("Could not open capture file '%s'.", captureFilename.toStdString().c_str());
+            delete captureFile;
+            captureFile = nullptr;
         }
+    }
 
-        /* The current client is disconnected, so destroy the object and start listening again */
-        if (client->state() == QLocalSocket::UnconnectedState) {
-            qDebug("Client disconnected");
-
-            delete client;
-            client = nullptr;
-
-            if (!server->listen(listenerName)) {
-                qDebug("Could not recreate a fluffelwatch socket (Error %d): %s",
-                       server->serverError(), server->errorString().toStdString().c_str());
-                break;
-            }
+    /* Run the event loop of this thread. All work is done in the handlers for the socket
+     * signals, so the thread sleeps until there is something to do or stop() is called. */
+    if (!isInterruptionRequested()) {
+        exec();
+    }
 
-            qDebug("Removed client. Recreated listener.");
-            continue;
-        }
+    /* Close all connections and the socket and remove it. The list is cleared first,
+     * since deleting a socket emits its disconnected signal. */
+    QList<clientConnection*> remaining = clients.values();
+    clients.clear();
 
-        /* Read data from connected client if available; will also reduce the CPU load */
-        if (client->waitForReadyRead(timeout)) {
-            /* Read data. The data is 1 byte for the loading/stoptimer byte and another
-             * 2 x 32bit integers (8 bytes) in size. The first 32bit integer is the
-             * "section number" used for autosplitting. The second 32bit integer is the
-             * state of the icons encoded as bits, i.e. 32 icons max (1 = on, 0 = off). */
-            listenerData value;
-            quint64 readbytes = client->read(reinterpret_cast<char*>(&value), sizeof(value));
-
-            if (readbytes == sizeof(listenerData)) {
-                qDebug("Read from socket: timercontrol = %d, section = %d, iconstates = 0x%08X",
-                       value.timercontrol, value.section, value.iconstates);
-                updateData(value);
-            }
-        }
+    for (int i = 0; i < remaining.size(); ++i) {
+        delete remaining[i]->socket;
+        delete remaining[i];
     }
 
-    /* Close the socket and remove it */
     closeListener();
     if (server != nullptr) {
+        QMutexLocker locker(&serverMutex);
         delete server;
+        server = nullptr;
     }
+
+    delete backlogTimer;
+    backlogTimer = nullptr;
+
+    delete captureFile;
+    captureFile = nullptr;
+}
+
+bool FluffelIPCThread::takeEvent(FluffelIPCThread::listenerEvent& event) {
+    if (events.pop(event)) {
+        return true;
+    }
+
+    /* The queue is empty, so allow the next signal. Check again afterwards, because
+     * an event might have been added right before the flag was cleared, in which
+     * case no signal was sent for it. */
+    notified.storeRelease(0);
+
+    return events.pop(event);
+}
+
+quint64 FluffelIPCThread::getOverflowCount() const {
+    return events.getOverflows();
+}
+
+FluffelIPCThread::statistics FluffelIPCThread::getStatistics() const {
+    statistics stats;
+    stats.bytes = statBytes.loadAcquire();
+    stats.frames = statFrames.loadAcquire();
+    stats.malformed = statMalformed.loadAcquire();
+
+    return stats;
 }
 
-FluffelIPCThread::listenerData FluffelIPCThread::getData() {
-    listenerData tempData = internalData;
+void FluffelIPCThread::sendPong(quint32 client, quint32 id, quint64 transitions) {
+    qint64 timestamp = FluffelTimer::monotonicNSecs();
 
-    /* Reset the timer control if this is a one-time-command (all above timeControlStart) */
-    if (tempData.timercontrol >= timeControlStart) {
-        internalData.timercontrol = 0;
+    /* The sockets live in this thread, so let its event loop write the answer */
+    QMutexLocker locker(&serverMutex);
+    if (server == nullptr) {
+        return;
     }
 
-    changed = false;    
-    return tempData;
+    QMetaObject::invokeMethod(server, [this, client, id, timestamp, transitions]() {
+        writePong(client, id, timestamp, transitions);
+    }, Qt::QueuedConnection);
+}
+
+void FluffelIPCThread::writePong(quint32 client, quint32 id, qint64 timestamp, quint64 transitions) {
+    for (auto it = clients.constBegin(); it != clients.constEnd(); ++it) {
+        if (it.value()->id != client) {
+            continue;
+        }
+
+        FluffelProtocol::pongFrame pong;
+        pong.header.length = sizeof(pong) - sizeof(pong.header);
+        pong.header.timestamp = timestamp;
+        pong.id = id;
+        pong.transitions = transitions;
+
+        it.key()->write(reinterpret_cast<const char*>(&pong), sizeof(pong));
+        break;
+    }
+}
+
+void FluffelIPCThread::setMergeRules(const FluffelStateMerger::rules& value) {
+    merger.setRules(value);
+}
+
+void FluffelIPCThread::setCaptureFile(const QString& filename) {
+    captureFilename = filename;
 }
 
-bool FluffelIPCThread::dataChanged() const {
-    return changed;
+void FluffelIPCThread::stop() {
+    /* Setting the interruption flag covers the case that the event loop is not running yet */
+    requestInterruption();
+    quit();
 }
 
 bool FluffelIPCThread::openListener() {
@@ -113,10 +168,12 @@ bool FluffelIPCThread::openListener() {
     closeListener();
 
     /* Object not created yet? Important here: do not provide any parent since the parent might be
-     * not in the same thread as QLocalServer, which causes some problems. */
+     * not in the same thread as QLocalServer, which causes some problems. The connection has to
+     * be direct, because this thread object itself lives in the main thread. */
     if (server == nullptr) {
+        QMutexLocker locker(&serverMutex);
         server = new QLocalServer();
-        server->moveToThread(this);
+        connect(server, &QLocalServer::newConnection, this, &FluffelIPCThread::onNewConnection, Qt::DirectConnection);
     }
 
     /* Create a socket server and start listening */
@@ -128,7 +185,7 @@ bool FluffelIPCThread::openListener() {
     qDebug("Starting listening at '%s'.", server->fullServerName().toStdString().c_str());
 
     /* Resetting the data here ensures that any new data sent by the client will be interpreted */
-    updateData(listenerData());
+    lastData = listenerData();
 
     return true;
 }
@@ -142,18 +199,196 @@ void FluffelIPCThread::closeListener() {
     QLocalServer::removeServer(listenerName);
 }
 
-void FluffelIPCThread::updateData(const FluffelIPCThread::listenerData& newdata) {
+void FluffelIPCThread::onNewConnection() {
+    /* Accept all clients that are waiting. Every client gets its own buffer and
+     * state, so a slow client never blocks the others. */
+    QLocalSocket *socket;
+
+    while ((socket = server->nextPendingConnection()) != nullptr) {
+        clientConnection *client = new clientConnection();
+        client->id = nextClientId++;
+        client->socket = socket;
+        clients.insert(socket, client);
+
+        qDebug("Client %u connected (%d clients).", client->id, clients.size());
+        capture(client->id, FluffelProtocol::captureConnect, -1, FluffelTimer::monotonicNSecs());
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); }, Qt::DirectConnection);
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { onDisconnected(socket); }, Qt::DirectConnection);
+
+        /* The client may have sent data before we connected the signals */
+        onReadyRead(socket);
+    }
+}
+
+void FluffelIPCThread::onReadyRead(QLocalSocket* socket) {
+    clientConnection *client = clients.value(socket, nullptr);
+    if (client == nullptr) {
+        return;
+    }
+
+    /* Take everything the socket has and process all complete frames, since readyRead
+     * is not emitted again for data that is already buffered. Partial frames stay in
+     * the reader until the rest arrives. */
+    quint64 bytes = client->reader.getBytes();
+    quint64 frames = client->reader.getFrames();
+    quint64 malformed = client->reader.getMalformedFrames();
+
+    QByteArray data = socket->readAll();
+
+    /* The data is captured as it was received, before it is read; also malformed frames
+     * and the way the stream was cut into pieces can be played back */
+    capture(client->id, FluffelProtocol::captureData, client->reader.getVersion(), FluffelTimer::monotonicNSecs(), data);
+    client->reader.append(data);
+
+    FluffelStreamReader::frame value;
+    FluffelStreamReader::result result;
+
+    while ((result = client->reader.readFrame(value)) == FluffelStreamReader::resultFrame) {
+        if (value.hasState) {
+            updateData(merger.update(client->id, value.state), value.timestamp);
+            continue;
+        }
+
+        /* All commands of a frame happened at the same time and are queued in order */
+        for (int i = 0; i < value.commands.size(); ++i) {
+            queueCommand(client->id, value.commands[i], value.timestamp);
+        }
+    }
+
+    statBytes.fetchAndAddOrdered(client->reader.getBytes() - bytes);
+    statFrames.fetchAndAddOrdered(client->reader.getFrames() - frames);
+    statMalformed.fetchAndAddOrdered(client->reader.getMalformedFrames() - malformed);
+
+    /* One write per batch keeps the capture complete up to here even after a crash */
+    if (captureFile != nullptr) {
+        captureFile->flush();
+    }
+
+    if (result == FluffelStreamReader::resultError) {
+        qDebug("Cannot read data from client %u. Disconnecting.", client->id);
+        socket->disconnectFromServer();
+    }
+}
+
+void FluffelIPCThread::onDisconnected(QLocalSocket* socket) {
+    clientConnection *client = clients.take(socket);
+    if (client == nullptr) {
+        return;
+    }
+
+    qDebug("Client %u disconnected (%llu bytes, %llu frames, %llu malformed frames, %llu unknown timer controls received)",
+           client->id, client->reader.getBytes(), client->reader.getFrames(), client->reader.getMalformedFrames(),
+           client->reader.getUnknownControls());
+
+    /* The state of this client does not count anymore; the merged state of the other
+     * clients is sent right away, e.g. a pause held only by this client ends now */
+    merger.remove(client->id);
+    capture(client->id, FluffelProtocol::captureDisconnect, client->reader.getVersion(), FluffelTimer::monotonicNSecs());
+
+    if (merger.getClientCount() > 0) {
+        updateData(merger.merged(), 0);
+    }
+
+    /* Resetting the data here ensures that any new data sent by a client will be interpreted */
+    if (clients.isEmpty()) {
+        lastData = listenerData();
+    }
+
+    socket->deleteLater();
+    delete client;
+}
+
+void FluffelIPCThread::updateData(const FluffelIPCThread::listenerData& newdata, qint64 timestamp) {
     /* Nothing changed, so do nothing here */
-    if (newdata == internalData) {
+    if (newdata == lastData) {
         return;
     }
 
-    accessMutex.lock();
-    internalData.timercontrol   = newdata.timercontrol;
-    internalData.section        = newdata.section;
-    internalData.iconstates     = newdata.iconstates;
-    changed = true;
-    accessMutex.unlock();
+    /* Reset the timer control if this is a one-time-command (all above timeControlStart), so
+     * that the same command can be sent again. */
+    lastData = newdata;
+    if (lastData.timercontrol >= FluffelProtocol::timeControlStart) {
+        lastData.timercontrol = 0;
+    }
+
+    listenerEvent event;
+    event.timestamp = eventTime(timestamp);
+    event.data = newdata;
+    queueEvent(event);
+}
+
+void FluffelIPCThread::queueCommand(quint32 client, const FluffelStreamReader::command& command, qint64 timestamp) {
+    listenerEvent event;
+    event.client = client;
+    event.timestamp = eventTime(timestamp);
+    event.type = command.type;
+    event.value = command.value;
+    event.icons = command.icons;
+    queueEvent(event);
+}
+
+void FluffelIPCThread::capture(quint32 client, quint8 event, int version, qint64 arrival, const QByteArray& data) {
+    if (captureFile == nullptr) {
+        return;
+    }
+
+    FluffelProtocol::captureRecord record;
+    record.arrival = arrival;
+    record.client = client;
+    record.event = event;
+    record.version = (version >= 0) ? version : 0;
+    record.length = data.size();
+
+    captureFile->write(reinterpret_cast<const char*>(&record), sizeof(record));
+    captureFile->write(data);
+}
+
+qint64 FluffelIPCThread::eventTime(qint64 timestamp) {
+    /* Timestamps from the client cannot be in the future or older than maxEventAge; use the
+     * current time if there is none. They also cannot be before the last event (e.g. of
+     * another client or a legacy one that got the time it was received), so a split never
+     * lands before the split before it. */
+    qint64 now = FluffelTimer::monotonicNSecs();
+    if (timestamp <= 0) {
+        timestamp = now;
+    }
+
+    lastEventTime = qBound(qMax(lastEventTime, now - maxEventAge), timestamp, now);
+    return lastEventTime;
+}
+
+void FluffelIPCThread::queueEvent(const FluffelIPCThread::listenerEvent& event) {
+    /* Keep the order: as long as there is a backlog, new events have to wait behind it */
+    if (!backlog.isEmpty() || !events.push(event)) {
+        backlog.enqueue(event);
+
+        if (!backlogTimer->isActive()) {
+            qDebug("Event queue is full, %d event(s) waiting.", backlog.size());
+            backlogTimer->start();
+        }
+    }
+
+    notifyEvents();
+}
+
+void FluffelIPCThread::flushBacklog() {
+    while (!backlog.isEmpty() && events.push(backlog.head())) {
+        backlog.dequeue();
+    }
+
+    if (backlog.isEmpty()) {
+        backlogTimer->stop();
+    }
+
+    notifyEvents();
+}
+
+void FluffelIPCThread::notifyEvents() {
+    /* Only send a signal if the main thread does not know about the events yet */
+    if (notified.testAndSetOrdered(0, 1)) {
+        emit eventsAvailable();
+    }
 }
 
 bool operator==(const FluffelIPCThread::listenerData& lhs, const FluffelIPCThread::listenerData& rhs) {
@@ -1,66 +1,162 @@
 #ifndef FLUFFELIPCTHREAD_H
 #define FLUFFELIPCTHREAD_H
 
+#include <QBitArray>
+#include <QFile>
+#include <QHash>
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QMutex>
+#include <QQueue>
 #include <QThread>
+#include <QTimer>
+
+#include "fluffeleventqueue.h"
+#include "fluffelprotocol.h"
+#include "fluffelstatemerger.h"
+#include "fluffelstreamreader.h"
 
 class FluffelIPCThread : public QThread
 {
+    Q_OBJECT
+
     public:
         FluffelIPCThread();
         ~FluffelIPCThread();
 
         void run() override;
 
-        static const int timeout;
+        /* Requests the thread to exit and stops its event loop immediately. Can be
+         * called from any thread. */
+        void stop();
+
         static const QString listenerName;
 
-        /* Data received by sockets. The pragma packing is important here,
-         * otherwise the compiler will align the structure (first member)
-         * and it will be hard to read from the socket the exact number of
-         * bytes. */
-#pragma pack(push, 1)
-        struct listenerData {
-                quint8  timercontrol = 0;
-                quint32 section = 0;
-                quint32 iconstates = 0;
+        /* How long before it was received an event can have happened (in ns). Older
+         * timestamps are moved to this point, so a bogus one cannot e.g. move the
+         * start of a run back by hours. */
+        static const qint64 maxEventAge;
+
+        /* Data received by sockets, see fluffelprotocol.h */
+        typedef FluffelProtocol::listenerData listenerData;
+
+        /* An event is either a change of the merged state (type eventState) or a command
+         * sent by a client (type is one of FluffelProtocol::command). For commands, value
+         * holds the section, game time or ping id and icons the icon states if needed, and
+         * client is the id of the client that sent it. The timestamp
+         * is the time it happened (monotonic clock, in ns): the time sent by the client or
+         * the time the data was received otherwise. */
+        enum eventType { eventState = 0 };
+
+        struct listenerEvent {
+                qint64 timestamp = 0;
+                int type = eventState;
+                listenerData data;
+                qint64 value = 0;
+                QBitArray icons;
+                quint32 client = 0;
         };
-#pragma pack(pop)
-        /* This enum describes the possible values of the timercontrol in
-         * the data struct above. All other values should be ignored.
-         * Note: These values only have effect if the respective options
-         * (autosplit, etc.) are set in Fluffelwatch by the user! */
-        enum control {
-            timeControlNone = 0,        /* Ingame timer should run normally (or continue if paused) */
-            timeControlPause = 1,       /* Ingame timer should be paused (usually done during loading times, etc.) */
-            timeControlStart = 200,     /* Both timers should be reset and started (usually done at the very beginning of a run) */
-            timeControlStop = 201,      /* Both timers should stopped (usually done at the very end of a run) */
+
+        /* Takes the oldest event received. Returns false if there are no more events.
+         * Must only be called from one thread (the consumer, i.e. the main thread). */
+        bool takeEvent(listenerEvent &event);
+
+        /* Number of times the event queue was full. Events are never dropped in this
+         * case, but delivered with some delay. */
+        quint64 getOverflowCount() const;
+
+        /* Number of bytes, frames and malformed frames received from all clients */
+        struct statistics {
+                quint64 bytes = 0;
+                quint64 frames = 0;
+                quint64 malformed = 0;
         };
 
-        /* Getter function will set the state changed to false */
-        listenerData getData();
+        statistics getStatistics() const;
+
+        /* Answers a ping of a client once it was processed. This is the hook for measuring
+         * the time from sending a command to applying it. Can be called from any thread. */
+        void sendPong(quint32 client, quint32 id, quint64 transitions);
+
+        /* Rules for merging the states of several clients. Must be set before the thread
+         * is started. */
+        void setMergeRules(const FluffelStateMerger::rules &value);
+
+        /* Captures everything the clients send into this file (see fluffelprotocol.h),
+         * for playing it back with fluffelreplay. An empty name turns it off. Must be
+         * set before the thread is started. */
+        void setCaptureFile(const QString &filename);
 
-        /* Call to find out if the internal data changed since the last read */
-        bool dataChanged() const;
+    signals:
+        /* Emitted from within this thread when new events are waiting in the queue. It is
+         * not emitted again until takeEvent() found the queue empty, so the receiver should
+         * take all events at once. Connect to it with a queued connection. */
+        void eventsAvailable();
 
     private:
         /* This is the local socket (or named pipe on other platforms) that will be used
-         * for interprocess communication (IPC). */
+         * for interprocess communication (IPC). It lives in this thread as well as all
+         * client connections. */
         QLocalServer *server = nullptr;
-        QLocalSocket *client = nullptr;
+        QMutex serverMutex;
+
+        /* A connected client with its own reassembly buffer */
+        struct clientConnection {
+                quint32 id = 0;
+                QLocalSocket *socket = nullptr;
+                FluffelStreamReader reader;
+        };
+
+        QHash<QLocalSocket*, clientConnection*> clients;
+        quint32 nextClientId = 1;
 
         /* Open and close the server socket */
         bool openListener();
         void closeListener();
 
-        /* Internal data */
-        QMutex accessMutex;
+        /* Handlers for the socket signals; these are called within this thread */
+        void onNewConnection();
+        void onReadyRead(QLocalSocket *socket);
+        void onDisconnected(QLocalSocket *socket);
+
+        /* Merges the states of all clients */
+        FluffelStateMerger merger;
+
+        /* Statistics of all clients so far; readable from other threads */
+        QAtomicInteger<quint64> statBytes;
+        QAtomicInteger<quint64> statFrames;
+        QAtomicInteger<quint64> statMalformed;
+
+        /* Capture of everything received (optional) */
+        QString captureFilename;
+        QFile *captureFile = nullptr;
+        void capture(quint32 client, quint8 event, int version, qint64 arrival, const QByteArray &data = QByteArray());
+
+        /* The last data received (one-time commands are already removed) */
+        listenerData lastData;
+        void updateData(const listenerData &newdata, qint64 timestamp);
+        void queueCommand(quint32 client, const FluffelStreamReader::command &command, qint64 timestamp);
+        void writePong(quint32 client, quint32 id, qint64 timestamp, quint64 transitions);
+
+        /* Time of the last event; events of all clients are kept in this order */
+        qint64 lastEventTime = 0;
+        qint64 eventTime(qint64 timestamp);
+
+        /* Events are handed to the main thread through this queue. If it is full, the
+         * events wait in the backlog (only used by this thread) and are moved into the
+         * queue as soon as there is room again. */
+        static const int backlogRetryInterval;
+
+        FluffelEventQueue<listenerEvent, 1024> events;
+        QQueue<listenerEvent> backlog;
+        QTimer *backlogTimer = nullptr;
+
+        void queueEvent(const listenerEvent &event);
+        void flushBacklog();
 
-        bool changed;
-        listenerData internalData;
-        void updateData(const listenerData &newdata);
+        /* Set while an eventsAvailable signal is pending */
+        QAtomicInt notified;
+        void notifyEvents();
 };
 
 bool operator==(const FluffelIPCThread::listenerData& lhs, const FluffelIPCThread::listenerData& rhs);
@@ -0,0 +1,326 @@
+#include "fluffeljournal.h"
+#include "fluffeltimer.h"
+#include "splitdata.h"
+#include "timecontroller.h"
+
+#include <QFile>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Interval for flushing the journal to the disk (in ms) */
+const int FluffelJournal::syncInterval = 1000;
+
+namespace {
+    /* Reads a value from the payload of a record; false if the payload is too short */
+    template <typename T>
+    bool readValue(const QByteArray &payload, int pos, T &value) {
+        if (pos + static_cast<int>(sizeof(value)) > payload.size()) {
+            return false;
+        }
+
+        memcpy(&value, payload.constData() + pos, sizeof(value));
+        return true;
+    }
+
+    qint64 realtimeNSecs() {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        return static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+}
+
+
+FluffelJournal::FluffelJournal() {
+    dirty = 0;
+
+    setObjectName("fluffelwatch journal thread");
+}
+
+FluffelJournal::~FluffelJournal() {
+    close();
+}
+
+bool FluffelJournal::open(const QString& filename, bool keep) {
+    close();
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (keep ? 0 : O_TRUNC);
+
+    fd = ::open(filename.toLocal8Bit().constData(), flags, 0644);
+    if (fd == -1) {
+        qDebug("Could not open journal '%s': %s", filename.toStdString().c_str(), strerror(errno));
+        return false;
+    }
+
+    this->filename = filename;
+
+    /* Remember the real time and the boot, so the monotonic timestamps of this session
+     * can be translated later */
+    QByteArray payload;
+    qint64 realtime = realtimeNSecs();
+    payload.append(reinterpret_cast<const char*>(&realtime), sizeof(realtime));
+    payload.append(bootId());
+
+    record(recordSession, FluffelTimer::monotonicNSecs(), payload);
+
+    stopping = false;
+    start(QThread::LowPriority);
+
+    qDebug("Writing journal to '%s'.", filename.toStdString().c_str());
+    return true;
+}
+
+void FluffelJournal::close() {
+    if (fd == -1) {
+        return;
+    }
+
+    /* Stop flushing first */
+    syncMutex.lock();
+    stopping = true;
+    syncCondition.wakeAll();
+    syncMutex.unlock();
+    wait();
+
+    /* Closed properly, so there is nothing to restore anymore */
+    if (ftruncate(fd, 0) == -1) {
+        qDebug("Could not empty journal '%s'.", filename.toStdString().c_str());
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+bool FluffelJournal::isOpen() const {
+    return fd != -1;
+}
+
+void FluffelJournal::record(quint8 type, qint64 timestamp, const QByteArray& payload) {
+    if (fd == -1) {
+        return;
+    }
+
+    recordHeader header;
+    header.type = type;
+    header.length = payload.size();
+    header.timestamp = timestamp;
+    header.checksum = checksum(header, payload);
+
+    /* One write per record, so a record is either appended completely or cut off at the end */
+    QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(payload);
+
+    int written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.constData() + written, data.size() - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            qDebug("Could not write to journal: %s", strerror(errno));
+            return;
+        }
+
+        written += n;
+    }
+
+    dirty.storeRelease(1);
+}
+
+bool FluffelJournal::read(const QString& filename, QVector<FluffelJournal::entry>& entries) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    file.close();
+
+    int pos = 0;
+    while (pos + static_cast<int>(sizeof(recordHeader)) <= data.size()) {
+        recordHeader header;
+        memcpy(&header, data.constData() + pos, sizeof(header));
+
+        if (pos + static_cast<int>(sizeof(header) + header.length) > data.size()) {
+            qDebug("Journal ends with an incomplete record.");
+            break;
+        }
+
+        entry value;
+        value.type = header.type;
+        value.timestamp = header.timestamp;
+        value.payload = data.mid(pos + sizeof(header), header.length);
+
+        if (checksum(header, value.payload) != header.checksum) {
+            qDebug("Journal record at %d is damaged, ignoring the rest.", pos);
+            break;
+        }
+
+        entries.append(value);
+        pos += sizeof(header) + header.length;
+    }
+
+    return true;
+}
+
+bool FluffelJournal::hasRun(const QVector<FluffelJournal::entry>& entries) {
+    for (int i = 0; i < entries.size(); ++i) {
+        if ((entries[i].type != recordSession) && (entries[i].type != recordLoad)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int FluffelJournal::replay(const QVector<FluffelJournal::entry>& entries, TimeController& timeControl, SplitData& data) {
+    QByteArray currentBoot = bootId();
+    qint64 realNow = realtimeNSecs();
+    qint64 monotonicNow = FluffelTimer::monotonicNSecs();
+
+    /* Difference between the monotonic clock of the session and the current one */
+    qint64 offset = 0;
+    int applied = 0;
+
+    /* The attempts that ended in the session are already in the history */
+    data.setHistoryEnabled(false);
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const entry &value = entries[i];
+        qint64 timestamp = value.timestamp + offset;
+
+        qint64 time = 0;
+        quint32 section = 0;
+        quint8 merge = 0;
+
+        switch (value.type) {
+            case recordSession: {
+                qint64 realThen;
+                if (!readValue(value.payload, 0, realThen)) {
+                    continue;
+                }
+
+                /* The monotonic clock continues within the same boot. After a reboot, it
+                 * starts again, so the timestamps are translated through the real time. */
+                if (value.payload.mid(sizeof(realThen)) == currentBoot) {
+                    offset = 0;
+                } else {
+                    offset = (realThen - value.timestamp) - (realNow - monotonicNow);
+                }
+                break;
+            }
+
+            case recordStart:
+                timeControl.startBothTimerAt(timestamp);
+                break;
+
+            case recordPause:
+                timeControl.pauseBothTimerAt(timestamp);
+                break;
+
+            case recordResume:
+                timeControl.resumeBothTimerAt(timestamp);
+                break;
+
+            case recordPauseIngame:
+                timeControl.pauseIngameTimerAt(timestamp);
+                break;
+
+            case recordResumeIngame:
+                timeControl.resumeIngameTimerAt(timestamp);
+                break;
+
+            case recordReset:
+                timeControl.resetBothTimer();
+                break;
+
+            case recordSetIngameTime:
+                if (!readValue(value.payload, 0, time)) {
+                    continue;
+                }
+                timeControl.setIngameTimeAt(time, timestamp);
+                break;
+
+            case recordSplit:
+                if (!readValue(value.payload, 0, time)) {
+                    continue;
+                }
+                data.split(time);
+                break;
+
+            case recordSplitToSection:
+                if (!readValue(value.payload, 0, section) || !readValue(value.payload, sizeof(section), time)) {
+                    continue;
+                }
+                data.splitToSection(section, time);
+                break;
+
+            case recordSkip:
+                data.skip();
+                break;
+
+            case recordUndo:
+                data.undoSplit();
+                break;
+
+            case recordDataReset:
+                if (!readValue(value.payload, 0, merge)) {
+                    continue;
+                }
+                data.reset(merge != 0);
+                break;
+
+            case recordLoad:
+                data.loadData(QString::fromUtf8(value.payload));
+                break;
+
+            default:
+                qDebug("Unknown journal record %d.", value.type);
+                continue;
+        }
+
+        applied++;
+    }
+
+    data.setHistoryEnabled(true);
+    return applied;
+}
+
+void FluffelJournal::run() {
+    /* Flush the records written since the last time; this may take a while, which is
+     * why it is done here and not in the main thread */
+    QMutexLocker locker(&syncMutex);
+
+    while (!stopping) {
+        syncCondition.wait(&syncMutex, syncInterval);
+
+        if (dirty.testAndSetOrdered(1, 0)) {
+            fdatasync(fd);
+        }
+    }
+}
+
+QByteArray FluffelJournal::bootId() {
+    /* Changes with every boot of the system */
+    QFile file("/proc/sys/kernel/random/boot_id");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    return file.readAll().trimmed();
+}
+
+quint16 FluffelJournal::checksum(const FluffelJournal::recordHeader& header, const QByteArray& payload) {
+    recordHeader copy = header;
+    copy.checksum = 0;
+
+    QByteArray data(reinterpret_cast<const char*>(&copy), sizeof(copy));
+    data.append(payload);
+
+    return qChecksum(data.constData(), data.size());
+}
@@ -0,0 +1,107 @@
+#ifndef FLUFFELJOURNAL_H
+#define FLUFFELJOURNAL_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+class SplitData;
+class TimeController;
+
+/* Append-only journal of everything that changes the timers or the split data
+ * during a run, so that a run can be restored after a crash. Each change is
+ * appended as a record right away (O_APPEND); this thread only flushes the file
+ * to the disk from time to time, so the main thread never waits for the disk.
+ *
+ * Every record has a header (see below) and a payload. A record that was only
+ * written partially (crash while writing) fails its checksum, so reading stops
+ * there. Timestamps are taken from the monotonic clock. Every time the journal
+ * is opened, a session record with the real time and the boot id is written,
+ * so the timestamps can be translated if the system was rebooted in between. */
+class FluffelJournal : public QThread
+{
+    Q_OBJECT
+
+    public:
+        FluffelJournal();
+        ~FluffelJournal();
+
+        enum recordType {
+            recordSession = 1,          /* int64 CLOCK_REALTIME in ns, then the boot id */
+            recordStart = 2,            /* TimeController */
+            recordPause = 3,
+            recordResume = 4,
+            recordPauseIngame = 5,
+            recordResumeIngame = 6,
+            recordReset = 7,
+            recordSetIngameTime = 8,    /* int64 ingame time in ns */
+            recordSplit = 9,            /* SplitData: int64 time of the split in ns */
+            recordSplitToSection = 10,  /* uint32 section, int64 time of the split in ns */
+            recordSkip = 11,
+            recordUndo = 12,
+            recordDataReset = 13,       /* uint8 merge */
+            recordLoad = 14,            /* file name (UTF-8) */
+        };
+
+#pragma pack(push, 1)
+        struct recordHeader {
+                quint8  type = 0;
+                quint8  reserved = 0;
+                quint16 checksum = 0;   /* qChecksum of the header (checksum = 0) and the payload */
+                quint32 length = 0;     /* length of the payload */
+                qint64  timestamp = 0;  /* CLOCK_MONOTONIC in ns */
+        };
+#pragma pack(pop)
+
+        struct entry {
+                quint8 type = 0;
+                qint64 timestamp = 0;
+                QByteArray payload;
+        };
+
+        /* Opens the journal and starts a new session in it. Without keep, the old
+         * content is removed. */
+        bool open(const QString &filename, bool keep);
+
+        /* Closes the journal; the file is emptied, since nothing needs to be restored */
+        void close();
+        bool isOpen() const;
+
+        /* Appends a record. Does nothing if the journal is not open. */
+        void record(quint8 type, qint64 timestamp, const QByteArray &payload = QByteArray());
+
+        /* Reads all complete records of a journal file */
+        static bool read(const QString &filename, QVector<entry> &entries);
+
+        /* True if the records describe a run that was not finished (i.e. anything
+         * happened apart from opening the journal and loading split data) */
+        static bool hasRun(const QVector<entry> &entries);
+
+        /* Applies the records to the timers and the split data. The journal of both must
+         * not be set while doing so. Returns the number of records applied. */
+        static int replay(const QVector<entry> &entries, TimeController &timeControl, SplitData &data);
+
+        /* The thread flushes the file to the disk */
+        void run() override;
+
+    private:
+        int fd = -1;
+        QString filename;
+
+        /* Flushing to the disk */
+        static const int syncInterval;
+
+        QAtomicInt dirty;
+        QMutex syncMutex;
+        QWaitCondition syncCondition;
+        bool stopping = false;
+
+        static QByteArray bootId();
+        static quint16 checksum(const recordHeader &header, const QByteArray &payload);
+};
+
+#endif // FLUFFELJOURNAL_H
@@ -0,0 +1,189 @@
+#ifndef FLUFFELPROTOCOL_H
+#define FLUFFELPROTOCOL_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+/* Definition of the data that fluffelfood programs send to Fluffelwatch through
+ * the local socket or shared memory. This header does not depend on Qt, so that
+ * autosplitters written in C/C++ can include it directly. All integers are
+ * little endian. */
+namespace FluffelProtocol {
+    /* Every connection starts in legacy mode, in which the client sends plain
+     * listenerData packets. A client can select another mode by sending a hello
+     * packet as the very first data. The magic starts with a byte that is not a
+     * valid timer control value, so legacy clients are never mistaken for it. */
+    const char helloMagic[3] = { 'F', 'L', 'W' };
+
+    enum version {
+        versionLegacy = 0,          /* listenerData packets only (no hello needed) */
+        versionTimestamped = 1,     /* timestampedData packets */
+        versionCommands = 2,        /* frames with a batch of commands (see below) */
+    };
+
+    /* The pragma packing is important here, otherwise the compiler will align
+     * the structures (first member) and it will be hard to read from the socket
+     * the exact number of bytes. */
+#pragma pack(push, 1)
+    /* The state of the autosplitter: 1 byte for the timer control, the section
+     * number used for autosplitting and the state of the icons encoded as bits,
+     * i.e. 32 icons max (1 = on, 0 = off). */
+    struct listenerData {
+            uint8_t  timercontrol = 0;
+            uint32_t section = 0;
+            uint32_t iconstates = 0;
+    };
+
+    /* Selects the mode of the connection */
+    struct helloData {
+            char    magic[3] = { helloMagic[0], helloMagic[1], helloMagic[2] };
+            uint8_t version = versionLegacy;
+    };
+
+    /* The state together with the time it changed. The timestamp is taken from
+     * CLOCK_MONOTONIC (in ns), so Fluffelwatch can pause and split at the exact
+     * time regardless of how long the packet took to get processed. */
+    struct timestampedData {
+            listenerData state;
+            int64_t      timestamp = 0;
+    };
+
+    /* In version 2, the client sends frames. Each frame starts with this header
+     * and is followed by length bytes of commands, which are applied in order
+     * as one transition. The timestamp (CLOCK_MONOTONIC in ns, 0 if unknown)
+     * is the time of all commands in the frame. */
+    struct frameHeader {
+            uint32_t length = 0;
+            int64_t  timestamp = 0;
+    };
+#pragma pack(pop)
+
+    /* Frames cannot be longer than this */
+    const uint32_t maxFrameLength = 65536;
+
+    /* Each command starts with one byte for its type followed by its arguments.
+     * Commands are applied as they are and not merged with other clients. */
+    enum command {
+        commandPause = 1,           /* Pauses the ingame timer */
+        commandResume = 2,          /* Resumes the ingame timer */
+        commandSplit = 3,           /* Splits (or starts the timers if not running) */
+        commandSplitToSection = 4,  /* uint32_t section: splits to the first segment with this section */
+        commandSetIcons = 5,        /* uint16_t count, then (count + 7) / 8 bytes: icon states, bit i in byte i / 8 */
+        commandSetGameTime = 6,     /* int64_t time in ms: sets the ingame time */
+        commandStart = 7,           /* Resets and starts both timers */
+        commandStop = 8,            /* Stops both timers and splits */
+        commandUndo = 9,            /* Undoes the last split */
+        commandSkip = 10,           /* Skips the current segment */
+        commandPing = 11,           /* uint32_t id: Fluffelwatch answers with a pong once the commands before are applied */
+        commandPong = 12,           /* Only sent by Fluffelwatch: uint32_t id, uint64_t number of ingame timer pauses/resumes applied */
+    };
+
+    /* Fluffelwatch answers a ping with a frame holding a single pong command. The
+     * timestamp of this frame is the time the ping was processed (for benchmarks). */
+#pragma pack(push, 1)
+    struct pongFrame {
+            frameHeader header;
+            uint8_t     type = commandPong;
+            uint32_t    id = 0;
+            uint64_t    transitions = 0;
+    };
+#pragma pack(pop)
+
+    /* Fluffelwatch can capture everything clients send into a file (see the capture
+     * setting), which fluffelreplay plays back later. The file starts with a
+     * captureHeader and is followed by records, each with the bytes of one read from
+     * the socket exactly as they were received (including the hello, malformed frames,
+     * and frames cut into pieces) or a connect/disconnect. */
+    const uint32_t captureMagic = 0x43574C46;         /* "FLWC" */
+    const uint32_t captureVersion = 2;
+
+    enum captureEvent {
+        captureConnect = 1,
+        captureData = 2,
+        captureDisconnect = 3,
+    };
+
+#pragma pack(push, 1)
+    struct captureHeader {
+            uint32_t magic = captureMagic;
+            uint32_t version = captureVersion;
+    };
+
+    struct captureRecord {
+            int64_t  arrival = 0;           /* CLOCK_MONOTONIC in ns when the data was received */
+            uint32_t client = 0;            /* id of the client connection */
+            uint8_t  event = captureData;
+            uint8_t  version = 0;           /* protocol version of the client before this data */
+            uint16_t reserved = 0;
+            uint32_t length = 0;            /* length of the data following */
+    };
+#pragma pack(pop)
+
+    /* Instead of the socket, a single high-frequency producer can publish its
+     * state in a shared memory page that Fluffelwatch creates with shm_open at
+     * sharedStateName (i.e. /dev/shm/fluffelwatch). The page is protected by a
+     * sequence lock: the sequence is odd while the producer writes, so writing
+     * and reading are plain memory accesses without any system call. Use the
+     * functions below to access the page. Only one producer may write to it. */
+    const char sharedStateName[] = "/fluffelwatch";
+    const uint32_t sharedStateMagic = 0x53574C46;     /* "FLWS" */
+    const uint32_t sharedStateVersion = 1;
+
+    struct sharedState {
+            uint32_t              magic;
+            uint32_t              version;
+            std::atomic<uint32_t> sequence;
+            uint32_t              reserved;
+            int64_t               timestamp;            /* CLOCK_MONOTONIC in ns, 0 if unknown */
+            listenerData          state;
+    };
+
+    /* Producer side: publishes a new state */
+    inline void publishSharedState(sharedState *shared, const listenerData &state, int64_t timestamp) {
+        uint32_t sequence = shared->sequence.load(std::memory_order_relaxed);
+
+        shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        memcpy(&shared->state, &state, sizeof(state));
+        shared->timestamp = timestamp;
+
+        shared->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /* Consumer side: reads a consistent copy of the state. Returns false if the
+     * producer was writing all the time (try again later). */
+    inline bool readSharedState(const sharedState *shared, listenerData &state, int64_t &timestamp, uint32_t &sequence) {
+        for (int tries = 0; tries < 100; ++tries) {
+            uint32_t before = shared->sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+
+            memcpy(&state, &shared->state, sizeof(state));
+            timestamp = shared->timestamp;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shared->sequence.load(std::memory_order_relaxed) == before) {
+                sequence = before;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /* This enum describes the possible values of the timercontrol in
+     * listenerData. All other values should be ignored.
+     * Note: These values only have effect if the respective options
+     * (autosplit, etc.) are set in Fluffelwatch by the user! */
+    enum control {
+        timeControlNone = 0,        /* Ingame timer should run normally (or continue if paused) */
+        timeControlPause = 1,       /* Ingame timer should be paused (usually done during loading times, etc.) */
+        timeControlStart = 200,     /* Both timers should be reset and started (usually done at the very beginning of a run) */
+        timeControlStop = 201,      /* Both timers should stopped (usually done at the very end of a run) */
+    };
+}
+
+#endif // FLUFFELPROTOCOL_H
@@ -0,0 +1,169 @@
+#include "fluffelpublisher.h"
+
+/* Server name for the socket */
+const QString FluffelPublisher::publisherName = "fluffelwatch-state";
+
+/* Overlays read every message right away; if this much is waiting, a subscriber is stalled */
+const qint64 FluffelPublisher::maxPendingBytes = 65536;
+
+
+FluffelPublisher::FluffelPublisher() {
+    server = nullptr;
+    notified = 0;
+    droppedSubscribers = 0;
+
+    setObjectName("fluffelwatch publisher thread");
+}
+
+FluffelPublisher::~FluffelPublisher() {
+}
+
+void FluffelPublisher::run() {
+    server = nullptr;
+    subscribers.clear();
+    latest.clear();
+
+    if (!openListener()) {
+        qDebug("Publisher socket could not be opened. Aborting thread.");
+        return;
+    }
+
+    /* Messages published before the server existed */
+    deliver();
+
+    if (!isInterruptionRequested()) {
+        exec();
+    }
+
+    /* The list is cleared first, since deleting a socket emits its disconnected signal */
+    QList<QLocalSocket*> remaining = subscribers;
+    subscribers.clear();
+    qDeleteAll(remaining);
+
+    closeListener();
+    if (server != nullptr) {
+        QMutexLocker locker(&serverMutex);
+        delete server;
+        server = nullptr;
+    }
+}
+
+void FluffelPublisher::stop() {
+    /* Setting the interruption flag covers the case that the event loop is not running yet */
+    requestInterruption();
+    quit();
+}
+
+void FluffelPublisher::publish(const QString& topic, const QByteArray& data) {
+    message value;
+    value.topic = topic;
+    value.data = data;
+
+    if (!messages.push(value)) {
+        return;
+    }
+
+    /* Wake up the thread unless a delivery is already pending */
+    if (!notified.testAndSetOrdered(0, 1)) {
+        return;
+    }
+
+    QMutexLocker locker(&serverMutex);
+    if (server == nullptr) {
+        notified.storeRelease(0);
+        return;
+    }
+
+    QMetaObject::invokeMethod(server, [this]() { deliver(); }, Qt::QueuedConnection);
+}
+
+quint64 FluffelPublisher::getDroppedMessages() const {
+    return messages.getOverflows();
+}
+
+quint64 FluffelPublisher::getDroppedSubscribers() const {
+    return droppedSubscribers.loadAcquire();
+}
+
+bool FluffelPublisher::openListener() {
+    closeListener();
+
+    /* No parent here; see FluffelIPCThread::openListener */
+    if (server == nullptr) {
+        QMutexLocker locker(&serverMutex);
+        server = new QLocalServer();
+        connect(server, &QLocalServer::newConnection, this, &FluffelPublisher::onNewConnection, Qt::DirectConnection);
+    }
+
+    if (!server->listen(publisherName)) {
+        qDebug("Could not create the publisher socket (Error %d): %s", server->serverError(), server->errorString().toStdString().c_str());
+        return false;
+    }
+
+    qDebug("Publishing state at '%s'.", server->fullServerName().toStdString().c_str());
+    return true;
+}
+
+void FluffelPublisher::closeListener() {
+    if (server != nullptr) {
+        server->close();
+    }
+    QLocalServer::removeServer(publisherName);
+}
+
+void FluffelPublisher::onNewConnection() {
+    QLocalSocket *socket;
+
+    while ((socket = server->nextPendingConnection()) != nullptr) {
+        subscribers.append(socket);
+        qDebug("Subscriber connected (%d subscribers).", subscribers.size());
+
+        /* Subscribers only listen; anything they send is thrown away */
+        connect(socket, &QLocalSocket::readyRead, this, [socket]() { socket->readAll(); }, Qt::DirectConnection);
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { onDisconnected(socket); }, Qt::DirectConnection);
+
+        /* Start with the current state */
+        for (auto it = latest.constBegin(); it != latest.constEnd(); ++it) {
+            write(socket, it.value());
+        }
+    }
+}
+
+void FluffelPublisher::onDisconnected(QLocalSocket* socket) {
+    if (!subscribers.removeOne(socket)) {
+        return;
+    }
+
+    qDebug("Subscriber disconnected (%d subscribers).", subscribers.size());
+    socket->deleteLater();
+}
+
+void FluffelPublisher::deliver() {
+    /* Allow the next wake-up before taking the messages, so none is left behind */
+    notified.storeRelease(0);
+
+    message value;
+    while (messages.pop(value)) {
+        latest.insert(value.topic, value.data);
+
+        /* Writing may drop a subscriber, which changes the list */
+        QList<QLocalSocket*> current = subscribers;
+        for (int i = 0; i < current.size(); ++i) {
+            write(current[i], value.data);
+        }
+    }
+}
+
+void FluffelPublisher::write(QLocalSocket* socket, const QByteArray& data) {
+    /* A stalled subscriber is dropped instead of buffering more and more for it */
+    if (socket->bytesToWrite() + data.size() > maxPendingBytes) {
+        qDebug("Subscriber does not read, dropping it.");
+        droppedSubscribers.fetchAndAddOrdered(1);
+        socket->abort();
+        onDisconnected(socket);
+        return;
+    }
+
+    /* QLocalSocket buffers the data and writes it as the subscriber reads */
+    socket->write(data);
+}
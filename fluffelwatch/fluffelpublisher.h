@@ -0,0 +1,82 @@
+#ifndef FLUFFELPUBLISHER_H
+#define FLUFFELPUBLISHER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+
+#include "fluffeleventqueue.h"
+
+/* Publishes the state of Fluffelwatch (timers, section, splits, icons) to any
+ * number of subscribers, e.g. stream overlays, through a second local socket.
+ * Each message is one line of JSON. The sockets live in this thread, so writing
+ * to them never delays the main thread: messages are handed over through a
+ * lock-free queue and subscribers that do not keep up are dropped. */
+class FluffelPublisher : public QThread
+{
+    Q_OBJECT
+
+    public:
+        FluffelPublisher();
+        ~FluffelPublisher();
+
+        void run() override;
+
+        /* Requests the thread to exit and stops its event loop immediately. Can be
+         * called from any thread. */
+        void stop();
+
+        static const QString publisherName;
+
+        /* Sends a message to all subscribers. The latest message of each topic is also
+         * sent to new subscribers, so they start with the current state. Never blocks;
+         * if the queue is full, the message is dropped. Must only be called from one
+         * thread (the main thread). */
+        void publish(const QString &topic, const QByteArray &message);
+
+        /* Number of messages dropped because the queue was full and number of subscribers
+         * dropped because they did not read */
+        quint64 getDroppedMessages() const;
+        quint64 getDroppedSubscribers() const;
+
+    private:
+        /* The server lives in this thread as well as all subscriber connections */
+        QLocalServer *server = nullptr;
+        QMutex serverMutex;
+
+        QList<QLocalSocket*> subscribers;
+
+        /* Latest message of each topic (only used by this thread) */
+        QMap<QString, QByteArray> latest;
+
+        /* Messages on their way from the main thread */
+        struct message {
+                QString topic;
+                QByteArray data;
+        };
+
+        FluffelEventQueue<message, 256> messages;
+
+        /* Set while a delivery is pending in this thread */
+        QAtomicInt notified;
+
+        QAtomicInteger<quint64> droppedSubscribers;
+
+        /* A subscriber is dropped if more than this is waiting to be written to it */
+        static const qint64 maxPendingBytes;
+
+        bool openListener();
+        void closeListener();
+
+        /* Handlers called within this thread */
+        void onNewConnection();
+        void onDisconnected(QLocalSocket *socket);
+        void deliver();
+        void write(QLocalSocket *socket, const QByteArray &data);
+};
+
+#endif // FLUFFELPUBLISHER_H
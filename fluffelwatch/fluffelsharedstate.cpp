@@ -0,0 +1,119 @@
+#include "fluffelsharedstate.h"
+#include "fluffeltimer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FluffelSharedState::FluffelSharedState() {
+    shared = nullptr;
+    lastSequence = 0;
+}
+
+FluffelSharedState::~FluffelSharedState() {
+    close();
+}
+
+bool FluffelSharedState::open() {
+    close();
+
+    /* Create the page (or take over an existing one, e.g. after a crash). Only the
+     * user (and root, which usually runs the fluffelfood) can write to it. */
+    int fd = shm_open(FluffelProtocol::sharedStateName, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        qDebug("Could not create shared memory '%s'.", FluffelProtocol::sharedStateName);
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(FluffelProtocol::sharedState)) == -1) {
+        qDebug("Could not resize shared memory.");
+        ::close(fd);
+        return false;
+    }
+
+    void *memory = mmap(nullptr, sizeof(FluffelProtocol::sharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        qDebug("Could not map shared memory.");
+        return false;
+    }
+
+    shared = static_cast<FluffelProtocol::sharedState*>(memory);
+
+    /* A new page is filled with zeros; set the header so producers know it is ready */
+    if ((shared->magic != FluffelProtocol::sharedStateMagic) || (shared->version != FluffelProtocol::sharedStateVersion)) {
+        shared->sequence.store(0);
+        shared->timestamp = 0;
+        shared->state = FluffelProtocol::listenerData();
+        shared->version = FluffelProtocol::sharedStateVersion;
+        shared->magic = FluffelProtocol::sharedStateMagic;
+    }
+
+    /* Do not interpret the state that is already there, only new ones */
+    lastSequence = shared->sequence.load();
+    lastData = FluffelIPCThread::listenerData();
+
+    qDebug("Reading shared state from '/dev/shm%s'.", FluffelProtocol::sharedStateName);
+    return true;
+}
+
+void FluffelSharedState::close() {
+    if (shared == nullptr) {
+        return;
+    }
+
+    munmap(shared, sizeof(FluffelProtocol::sharedState));
+    shm_unlink(FluffelProtocol::sharedStateName);
+    shared = nullptr;
+}
+
+bool FluffelSharedState::isOpen() const {
+    return shared != nullptr;
+}
+
+bool FluffelSharedState::poll(FluffelIPCThread::listenerEvent& event) {
+    if (shared == nullptr) {
+        return false;
+    }
+
+    /* Nothing published since the last time (this is the usual case) */
+    if (shared->sequence.load(std::memory_order_acquire) == lastSequence) {
+        return false;
+    }
+
+    FluffelIPCThread::listenerData state;
+    int64_t timestamp;
+    uint32_t sequence;
+
+    if (!FluffelProtocol::readSharedState(shared, state, timestamp, sequence)) {
+        return false;
+    }
+
+    lastSequence = sequence;
+
+    /* Nothing changed, so do nothing here */
+    if (state == lastData) {
+        return false;
+    }
+
+    /* Reset the timer control if this is a one-time-command, so that the same command
+     * can be published again. */
+    lastData = state;
+    if (lastData.timercontrol >= FluffelProtocol::timeControlStart) {
+        lastData.timercontrol = 0;
+    }
+
+    /* Timestamps from the producer cannot be in the future, older than the socket allows
+     * or before the last state */
+    qint64 now = FluffelTimer::monotonicNSecs();
+    if (timestamp <= 0) {
+        timestamp = now;
+    }
+
+    lastEventTime = qBound(qMax(lastEventTime, now - FluffelIPCThread::maxEventAge), timestamp, now);
+    event.timestamp = lastEventTime;
+    event.data = state;
+    return true;
+}
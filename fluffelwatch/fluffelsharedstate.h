@@ -0,0 +1,33 @@
+#ifndef FLUFFELSHAREDSTATE_H
+#define FLUFFELSHAREDSTATE_H
+
+#include "fluffelipcthread.h"
+#include "fluffelprotocol.h"
+
+/* Reads the state published by an autosplitter in shared memory (see
+ * fluffelprotocol.h). The page is created when opened and removed when
+ * closed. Reading the state does not need any system call, so it can be
+ * polled on every timer tick. */
+class FluffelSharedState {
+  public:
+    FluffelSharedState();
+    ~FluffelSharedState();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    /* Returns true and fills in the event if the producer published a new state
+     * since the last call. Unchanged states are ignored like on the socket. */
+    bool poll(FluffelIPCThread::listenerEvent &event);
+
+  private:
+    FluffelProtocol::sharedState *shared;
+
+    /* Sequence number and state of the last read */
+    uint32_t lastSequence;
+    FluffelIPCThread::listenerData lastData;
+    qint64 lastEventTime = 0;
+};
+
+#endif // FLUFFELSHAREDSTATE_H
@@ -0,0 +1,128 @@
+#include "fluffelstatemerger.h"
+
+FluffelStateMerger::FluffelStateMerger() {
+
+}
+
+FluffelStateMerger::~FluffelStateMerger() {
+
+}
+
+void FluffelStateMerger::setRules(const FluffelStateMerger::rules& value) {
+    mergeRules = value;
+}
+
+FluffelStateMerger::rules FluffelStateMerger::getRules() const {
+    return mergeRules;
+}
+
+FluffelStateMerger::rules FluffelStateMerger::rulesFromStrings(const QString& icons, const QString& section, const QStringList& priority) {
+    rules value;
+
+    if (icons.trimmed().toLower() == "latest") {
+        value.icons = iconsLatest;
+    }
+
+    if (section.trimmed().toLower() == "latest") {
+        value.section = sectionLatest;
+    }
+
+    /* Only take the priority list if all entries are valid numbers */
+    QList<quint8> controls;
+    for (int i = 0; i < priority.size(); ++i) {
+        bool ok = false;
+        uint control = priority[i].trimmed().toUInt(&ok);
+
+        if (!ok || (control > 255)) {
+            qDebug("Invalid timer control '%s' in priority list.", priority[i].toStdString().c_str());
+            controls.clear();
+            break;
+        }
+
+        controls.append(static_cast<quint8>(control));
+    }
+
+    if (!controls.isEmpty()) {
+        value.controlPriority = controls;
+    }
+
+    return value;
+}
+
+FluffelProtocol::listenerData FluffelStateMerger::update(quint32 client, const FluffelProtocol::listenerData& state) {
+    states[client] = state;
+    latestClient = client;
+
+    FluffelProtocol::listenerData merged = merge();
+
+    /* One-time commands are not kept, but they always go through */
+    if (state.timercontrol >= FluffelProtocol::timeControlStart) {
+        states[client].timercontrol = FluffelProtocol::timeControlNone;
+        merged.timercontrol = state.timercontrol;
+    }
+
+    return merged;
+}
+
+void FluffelStateMerger::remove(quint32 client) {
+    states.remove(client);
+
+    /* The "latest" rules fall back to another client */
+    if ((latestClient == client) && !states.isEmpty()) {
+        latestClient = states.lastKey();
+    }
+}
+
+void FluffelStateMerger::clear() {
+    states.clear();
+}
+
+FluffelProtocol::listenerData FluffelStateMerger::merged() const {
+    return merge();
+}
+
+int FluffelStateMerger::getClientCount() const {
+    return states.size();
+}
+
+FluffelProtocol::listenerData FluffelStateMerger::merge() const {
+    FluffelProtocol::listenerData merged;
+
+    if (states.isEmpty()) {
+        return merged;
+    }
+
+    /* Start with the latest state for the "latest" rules */
+    const FluffelProtocol::listenerData latest = states.value(latestClient);
+
+    merged.iconstates = (mergeRules.icons == iconsLatest) ? latest.iconstates : 0;
+    merged.section = (mergeRules.section == sectionLatest) ? latest.section : 0;
+    merged.timercontrol = latest.timercontrol;
+
+    int bestRank = controlRank(merged.timercontrol);
+
+    for (auto it = states.constBegin(); it != states.constEnd(); ++it) {
+        if (mergeRules.icons == iconsOr) {
+            merged.iconstates |= it.value().iconstates;
+        }
+
+        if (mergeRules.section == sectionMax) {
+            merged.section = qMax(merged.section, it.value().section);
+        }
+
+        /* Lower rank means higher priority */
+        int rank = controlRank(it.value().timercontrol);
+        if (rank < bestRank) {
+            bestRank = rank;
+            merged.timercontrol = it.value().timercontrol;
+        }
+    }
+
+    return merged;
+}
+
+int FluffelStateMerger::controlRank(quint8 timercontrol) const {
+    int rank = mergeRules.controlPriority.indexOf(timercontrol);
+
+    return (rank == -1) ? mergeRules.controlPriority.size() : rank;
+}
@@ -0,0 +1,64 @@
+#ifndef FLUFFELSTATEMERGER_H
+#define FLUFFELSTATEMERGER_H
+
+#include <QList>
+#include <QMap>
+#include <QStringList>
+
+#include "fluffelprotocol.h"
+
+/* Merges the states of several clients (producers) into one state, e.g. when
+ * one program detects loading screens and another one missions. Each client
+ * has its own state and the merged state is calculated by the rules below. */
+class FluffelStateMerger {
+  public:
+    FluffelStateMerger();
+    ~FluffelStateMerger();
+
+    /* How icon states and section numbers are merged */
+    enum iconRule { iconsOr = 0, iconsLatest = 1 };
+    enum sectionRule { sectionMax = 0, sectionLatest = 1 };
+
+    struct rules {
+        iconRule icons = iconsOr;
+        sectionRule section = sectionMax;
+
+        /* Timer control values from the highest to the lowest priority; the merged
+         * timer control is the one of all clients that comes first in this list.
+         * Values not in the list come last. */
+        QList<quint8> controlPriority = { FluffelProtocol::timeControlStop, FluffelProtocol::timeControlStart,
+                                          FluffelProtocol::timeControlPause, FluffelProtocol::timeControlNone };
+    };
+
+    void setRules(const rules &value);
+    rules getRules() const;
+
+    /* Reads the rules from strings as used in the settings file, e.g. "or"/"latest",
+     * "max"/"latest" and a list of control values. Unknown values keep the default. */
+    static rules rulesFromStrings(const QString &icons, const QString &section, const QStringList &priority);
+
+    /* Sets the state of a client and returns the new merged state. One-time commands
+     * (start, stop) are passed through once and are not kept for the client. */
+    FluffelProtocol::listenerData update(quint32 client, const FluffelProtocol::listenerData &state);
+
+    /* Forgets the state of a client */
+    void remove(quint32 client);
+    void clear();
+
+    /* Merged state of the clients as they are now, without one-time commands */
+    FluffelProtocol::listenerData merged() const;
+
+    int getClientCount() const;
+
+  private:
+    rules mergeRules;
+
+    /* States of all clients and the client that sent the latest state */
+    QMap<quint32, FluffelProtocol::listenerData> states;
+    quint32 latestClient = 0;
+
+    FluffelProtocol::listenerData merge() const;
+    int controlRank(quint8 timercontrol) const;
+};
+
+#endif // FLUFFELSTATEMERGER_H
@@ -0,0 +1,270 @@
+#include "fluffelstreamreader.h"
+
+#include <string.h>
+
+FluffelStreamReader::FluffelStreamReader() {
+    bytes = 0;
+    frames = 0;
+    malformed = 0;
+    unknownControls = 0;
+
+    reset();
+}
+
+FluffelStreamReader::~FluffelStreamReader() {
+
+}
+
+void FluffelStreamReader::append(const QByteArray& data) {
+    buffer.append(data);
+    bytes += data.size();
+}
+
+FluffelStreamReader::result FluffelStreamReader::readFrame(FluffelStreamReader::frame& value) {
+    if (failed) {
+        return resultError;
+    }
+
+    /* Find out which protocol the client speaks first */
+    if ((version == -1) && !readHello()) {
+        return failed ? resultError : resultNeedData;
+    }
+
+    /* Go through the buffer until there is a valid frame or not enough data */
+    while (true) {
+        if (version == FluffelProtocol::versionCommands) {
+            FluffelProtocol::frameHeader header;
+            if (available() < static_cast<int>(sizeof(header))) {
+                break;
+            }
+
+            memcpy(&header, buffer.constData() + readPos, sizeof(header));
+
+            /* A wrong length means that the stream is broken, it cannot be read anymore */
+            if (header.length > FluffelProtocol::maxFrameLength) {
+                qDebug("Client sent a frame with %u bytes.", header.length);
+                malformed++;
+                failed = true;
+                return resultError;
+            }
+
+            if (available() < static_cast<int>(sizeof(header) + header.length)) {
+                break;
+            }
+
+            const char *data = buffer.constData() + readPos + sizeof(header);
+            readPos += sizeof(header) + header.length;
+
+            value.hasState = false;
+            value.timestamp = header.timestamp;
+            value.commands.clear();
+
+            /* The length tells us where the next frame starts, so a malformed frame can be skipped */
+            if (!readCommands(data, header.length, value.commands)) {
+                malformed++;
+                continue;
+            }
+
+            frames++;
+            return resultFrame;
+        }
+
+        value.hasState = true;
+        value.commands.clear();
+
+        if (version == FluffelProtocol::versionTimestamped) {
+            FluffelProtocol::timestampedData data;
+            if (available() < static_cast<int>(sizeof(data))) {
+                break;
+            }
+
+            memcpy(&data, buffer.constData() + readPos, sizeof(data));
+            readPos += sizeof(data);
+
+            value.state = data.state;
+            value.timestamp = data.timestamp;
+        } else {
+            if (available() < static_cast<int>(sizeof(value.state))) {
+                break;
+            }
+
+            memcpy(&value.state, buffer.constData() + readPos, sizeof(value.state));
+            readPos += sizeof(value.state);
+
+            value.timestamp = 0;
+        }
+
+        /* Only an unknown timer control is ignored: the one before stays in effect (one-time
+         * commands are not repeated), and the section and icons still count */
+        if (!isValidControl(value.state.timercontrol)) {
+            value.state.timercontrol = lastControl;
+            unknownControls++;
+        } else if (value.state.timercontrol < FluffelProtocol::timeControlStart) {
+            lastControl = value.state.timercontrol;
+        } else {
+            lastControl = FluffelProtocol::timeControlNone;
+        }
+
+        frames++;
+        return resultFrame;
+    }
+
+    compact();
+    return resultNeedData;
+}
+
+void FluffelStreamReader::reset() {
+    buffer.clear();
+    readPos = 0;
+    version = -1;
+    failed = false;
+    lastControl = FluffelProtocol::timeControlNone;
+}
+
+int FluffelStreamReader::getVersion() const {
+    return version;
+}
+
+quint64 FluffelStreamReader::getBytes() const {
+    return bytes;
+}
+
+quint64 FluffelStreamReader::getFrames() const {
+    return frames;
+}
+
+quint64 FluffelStreamReader::getMalformedFrames() const {
+    return malformed;
+}
+
+quint64 FluffelStreamReader::getUnknownControls() const {
+    return unknownControls;
+}
+
+bool FluffelStreamReader::readHello() {
+    if (available() < 1) {
+        return false;
+    }
+
+    /* Legacy clients start directly with a state packet, whose first byte never
+     * equals the first byte of the hello magic. */
+    if (buffer.at(readPos) != FluffelProtocol::helloMagic[0]) {
+        version = FluffelProtocol::versionLegacy;
+        return true;
+    }
+
+    /* Wait for the complete hello */
+    FluffelProtocol::helloData hello;
+    if (available() < static_cast<int>(sizeof(hello))) {
+        return false;
+    }
+
+    memcpy(&hello, buffer.constData() + readPos, sizeof(hello));
+    readPos += sizeof(hello);
+
+    if ((hello.magic[1] != FluffelProtocol::helloMagic[1]) || (hello.magic[2] != FluffelProtocol::helloMagic[2])
+            || (hello.version > FluffelProtocol::versionCommands)) {
+        qDebug("Client sent an unknown hello (version %d).", hello.version);
+        malformed++;
+        failed = true;
+        return false;
+    }
+
+    qDebug("Client uses protocol version %d", hello.version);
+    version = hello.version;
+    return true;
+}
+
+int FluffelStreamReader::available() const {
+    return buffer.size() - readPos;
+}
+
+void FluffelStreamReader::compact() {
+    /* Only called once all complete frames are read, so at most one partial frame
+     * is moved to the front here. */
+    if (readPos > 0) {
+        buffer.remove(0, readPos);
+        readPos = 0;
+    }
+}
+
+bool FluffelStreamReader::isValidControl(quint8 timercontrol) {
+    return (timercontrol == FluffelProtocol::timeControlNone) || (timercontrol == FluffelProtocol::timeControlPause)
+            || (timercontrol == FluffelProtocol::timeControlStart) || (timercontrol == FluffelProtocol::timeControlStop);
+}
+
+bool FluffelStreamReader::readCommands(const char* data, int length, QVector<FluffelStreamReader::command>& commands) {
+    int pos = 0;
+
+    while (pos < length) {
+        command cmd;
+        cmd.type = static_cast<quint8>(data[pos++]);
+
+        switch (cmd.type) {
+            case FluffelProtocol::commandPause:
+            case FluffelProtocol::commandResume:
+            case FluffelProtocol::commandSplit:
+            case FluffelProtocol::commandStart:
+            case FluffelProtocol::commandStop:
+            case FluffelProtocol::commandUndo:
+            case FluffelProtocol::commandSkip:
+                break;
+
+            case FluffelProtocol::commandSplitToSection:
+            case FluffelProtocol::commandPing: {
+                /* Section number or ping id */
+                quint32 number;
+                if (pos + static_cast<int>(sizeof(number)) > length) {
+                    return false;
+                }
+
+                memcpy(&number, data + pos, sizeof(number));
+                pos += sizeof(number);
+                cmd.value = number;
+                break;
+            }
+
+            case FluffelProtocol::commandSetGameTime: {
+                qint64 time;
+                if (pos + static_cast<int>(sizeof(time)) > length) {
+                    return false;
+                }
+
+                memcpy(&time, data + pos, sizeof(time));
+                pos += sizeof(time);
+                cmd.value = time;
+                break;
+            }
+
+            case FluffelProtocol::commandSetIcons: {
+                quint16 count;
+                if (pos + static_cast<int>(sizeof(count)) > length) {
+                    return false;
+                }
+
+                memcpy(&count, data + pos, sizeof(count));
+                pos += sizeof(count);
+
+                int bytes = (count + 7) / 8;
+                if (pos + bytes > length) {
+                    return false;
+                }
+
+                cmd.icons = QBitArray(count);
+                for (int i = 0; i < count; ++i) {
+                    cmd.icons.setBit(i, data[pos + i / 8] & (1 << (i % 8)));
+                }
+                pos += bytes;
+                break;
+            }
+
+            default:
+                qDebug("Unknown command %d in frame.", cmd.type);
+                return false;
+        }
+
+        commands.append(cmd);
+    }
+
+    return true;
+}
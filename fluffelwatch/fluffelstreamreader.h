@@ -0,0 +1,93 @@
+#ifndef FLUFFELSTREAMREADER_H
+#define FLUFFELSTREAMREADER_H
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QVector>
+
+#include "fluffelprotocol.h"
+
+/* Reassembles the frames sent by one client. Data is appended as it arrives
+ * from the socket (in pieces of any size) and complete frames can then be
+ * taken one by one. Incomplete frames stay in the buffer until the rest
+ * arrives. */
+class FluffelStreamReader {
+  public:
+    FluffelStreamReader();
+    ~FluffelStreamReader();
+
+    /* A command of a version 2 frame; value is the section, game time or ping id */
+    struct command {
+        quint8 type = 0;
+        qint64 value = 0;
+        QBitArray icons;
+    };
+
+    /* A complete frame: either a state (versions 0 and 1) or a batch of commands
+     * (version 2). The timestamp is 0 if the client did not send one. */
+    struct frame {
+        bool hasState = false;
+        FluffelProtocol::listenerData state;
+        QVector<command> commands;
+        qint64 timestamp = 0;
+    };
+
+    enum result {
+        resultFrame = 0,        /* A frame was read */
+        resultNeedData = 1,     /* No complete frame in the buffer */
+        resultError = 2,        /* The stream cannot be read anymore (e.g. unknown protocol) */
+    };
+
+    /* Adds data received from the socket */
+    void append(const QByteArray &data);
+
+    /* Takes the next complete frame from the buffer. Malformed frames are counted
+     * and skipped. */
+    result readFrame(frame &value);
+
+    /* Clears the buffer and the protocol version (for a new connection) */
+    void reset();
+
+    /* Protocol version of the stream; -1 as long as it is not known */
+    int getVersion() const;
+
+    /* Statistics */
+    quint64 getBytes() const;
+    quint64 getFrames() const;
+    quint64 getMalformedFrames() const;
+
+    /* State frames whose unknown timer control was ignored */
+    quint64 getUnknownControls() const;
+
+  private:
+    QByteArray buffer;
+    int readPos;
+
+    int version;
+    bool failed;
+
+    /* Timer control of the last state frame, used instead of unknown ones */
+    quint8 lastControl;
+
+    quint64 bytes;
+    quint64 frames;
+    quint64 malformed;
+    quint64 unknownControls;
+
+    /* Reads the hello (if any) and sets the version. Returns false if more data is needed
+     * or the stream failed. */
+    bool readHello();
+
+    /* Number of bytes left to read in the buffer */
+    int available() const;
+
+    /* Removes all bytes read from the buffer */
+    void compact();
+
+    static bool isValidControl(quint8 timercontrol);
+
+    /* Parses the commands of a version 2 frame; returns false if a command is malformed */
+    static bool readCommands(const char *data, int length, QVector<command> &commands);
+};
+
+#endif // FLUFFELSTREAMREADER_H
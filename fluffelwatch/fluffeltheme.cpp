@@ -0,0 +1,71 @@
+#include "fluffeltheme.h"
+
+const char *FluffelTheme::fontKeys[fontCount] = {
+    "mainTitle", "segmentTitle", "segmentDiff", "segmentTime", "realTimer", "ingameTimer"
+};
+
+const char *FluffelTheme::colorKeys[colorCount] = {
+    "background", "mainTitle", "separatorLine", "segmentTitle", "segmentTime", "currentSegment",
+    "gainedTime", "lostTime", "newRecord", "realTimer", "ingameTimer"
+};
+
+FluffelTheme::FluffelTheme() {
+    for (int i = 0; i < fontCount; ++i) {
+        fontMetrics.append(QFontMetrics(fonts[i]));
+    }
+}
+
+FluffelTheme::~FluffelTheme() {
+
+}
+
+void FluffelTheme::load(QSettings& settings) {
+    /* Fonts are stored as strings, which are converted to a QFont by fromString */
+    settings.beginGroup("Fonts");
+
+    fontMetrics.clear();
+    for (int i = 0; i < fontCount; ++i) {
+        fonts[i] = QFont();
+
+        QFont value;
+        if (settings.contains(fontKeys[i]) && value.fromString(settings.value(fontKeys[i]).toString())) {
+            fonts[i] = value;
+        }
+
+        fontMetrics.append(QFontMetrics(fonts[i]));
+    }
+
+    settings.endGroup();
+
+    /* Colors are stored as names (e.g. #rrggbb) */
+    settings.beginGroup("Colors");
+
+    for (int i = 0; i < colorCount; ++i) {
+        colors[i] = settings.contains(colorKeys[i]) ? QColor(settings.value(colorKeys[i]).toString()) : QColor();
+        pens[i] = QPen(colors[i]);
+    }
+
+    settings.endGroup();
+
+    background = QBrush(colors[colorBackground]);
+}
+
+const QFont& FluffelTheme::getFont(FluffelTheme::font value) const {
+    return fonts[value];
+}
+
+const QFontMetrics& FluffelTheme::getFontMetrics(FluffelTheme::font value) const {
+    return fontMetrics.at(value);
+}
+
+const QColor& FluffelTheme::getColor(FluffelTheme::color value) const {
+    return colors[value];
+}
+
+const QPen& FluffelTheme::getPen(FluffelTheme::color value) const {
+    return pens[value];
+}
+
+const QBrush& FluffelTheme::getBackground() const {
+    return background;
+}
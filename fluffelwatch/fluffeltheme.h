@@ -0,0 +1,67 @@
+#ifndef FLUFFELTHEME_H
+#define FLUFFELTHEME_H
+
+#include <QBrush>
+#include <QColor>
+#include <QFont>
+#include <QFontMetrics>
+#include <QList>
+#include <QPen>
+#include <QSettings>
+
+/* Fonts and colors of the main window, read from the Fonts and Colors groups of
+ * the settings. Everything is looked up by enum and the font metrics, pens and
+ * the background brush are prepared when loading, so painting does no lookups
+ * by name. */
+class FluffelTheme {
+  public:
+    FluffelTheme();
+    ~FluffelTheme();
+
+    enum font {
+        fontMainTitle = 0,
+        fontSegmentTitle,
+        fontSegmentDiff,
+        fontSegmentTime,
+        fontRealTimer,
+        fontIngameTimer,
+        fontCount
+    };
+
+    enum color {
+        colorBackground = 0,
+        colorMainTitle,
+        colorSeparatorLine,
+        colorSegmentTitle,
+        colorSegmentTime,
+        colorCurrentSegment,
+        colorGainedTime,
+        colorLostTime,
+        colorNewRecord,
+        colorRealTimer,
+        colorIngameTimer,
+        colorCount
+    };
+
+    /* Reads the fonts and colors; missing ones are default constructed */
+    void load(QSettings &settings);
+
+    const QFont &getFont(font value) const;
+    const QFontMetrics &getFontMetrics(font value) const;
+    const QColor &getColor(color value) const;
+    const QPen &getPen(color value) const;
+    const QBrush &getBackground() const;
+
+  private:
+    /* Keys in the settings, in the order of the enums */
+    static const char *fontKeys[fontCount];
+    static const char *colorKeys[colorCount];
+
+    QFont fonts[fontCount];
+    QList<QFontMetrics> fontMetrics;
+    QColor colors[colorCount];
+    QPen pens[colorCount];
+    QBrush background;
+};
+
+#endif // FLUFFELTHEME_H
@@ -0,0 +1,145 @@
+#include "fluffeltimecolumn.h"
+
+#include <string.h>
+
+/* The vector kernels need GCC or Clang on x86-64: SSE2 is always there, AVX2 is
+ * compiled for its functions only and used if the CPU has it. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define FLUFFEL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+FluffelTimeColumn::FluffelTimeColumn() {
+    values = nullptr;
+    count = 0;
+    capacity = 0;
+}
+
+FluffelTimeColumn::~FluffelTimeColumn() {
+    qFreeAligned(values);
+}
+
+void FluffelTimeColumn::resize(int count) {
+    if (count > capacity) {
+        /* Grow at least to the double size, so appending stays cheap */
+        int newCapacity = qMax(qMax(count, capacity * 2), 16);
+        qint64 *newValues = static_cast<qint64*>(qMallocAligned(newCapacity * sizeof(qint64), alignment));
+
+        if (this->count > 0) {
+            memcpy(newValues, values, this->count * sizeof(qint64));
+        }
+
+        qFreeAligned(values);
+        values = newValues;
+        capacity = newCapacity;
+    }
+
+    if (count > this->count) {
+        memset(values + this->count, 0, (count - this->count) * sizeof(qint64));
+    }
+
+    this->count = count;
+}
+
+void FluffelTimeColumn::append(qint64 value) {
+    resize(count + 1);
+    values[count - 1] = value;
+}
+
+void FluffelTimeColumn::clear() {
+    count = 0;
+}
+
+int FluffelTimeColumn::size() const {
+    return count;
+}
+
+qint64* FluffelTimeColumn::data() {
+    return values;
+}
+
+const qint64* FluffelTimeColumn::data() const {
+    return values;
+}
+
+qint64& FluffelTimeColumn::operator[](int index) {
+    return values[index];
+}
+
+qint64 FluffelTimeColumn::operator[](int index) const {
+    return values[index];
+}
+
+qint64& FluffelTimeColumn::last() {
+    return values[count - 1];
+}
+
+/* Plain version; it also does the rest of the vector versions */
+static qint64 prefixSumScalar(const qint64 *in, qint64 *out, int count, qint64 start) {
+    for (int i = 0; i < count; ++i) {
+        start += in[i];
+        out[i] = start;
+    }
+
+    return start;
+}
+
+#ifdef FLUFFEL_KERNELS_X86
+/* SSE2: two times per register. The prefix sum adds each register shifted by one
+ * element to itself and then the carry, which is the last sum broadcast. */
+static qint64 prefixSumSSE2(const qint64 *in, qint64 *out, int count, qint64 start) {
+    __m128i carry = _mm_set1_epi64x(start);
+    int i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    return prefixSumScalar(in + i, out + i, count - i, i > 0 ? out[i - 1] : start);
+}
+
+/* AVX2: four times per register. Shifts only work within the two halves, so the
+ * prefix sum needs a second step that adds the end of the lower half to the upper. */
+__attribute__((target("avx2")))
+static qint64 prefixSumAVX2(const qint64 *in, qint64 *out, int count, qint64 start) {
+    __m256i carry = _mm256_set1_epi64x(start);
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(zero, _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 1, 1, 1)), 0xF0));
+        x = _mm256_add_epi64(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+        carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    return prefixSumScalar(in + i, out + i, count - i, i > 0 ? out[i - 1] : start);
+}
+#endif
+
+/* The kernel is chosen once, the first time it is used */
+typedef qint64 (*prefixSumKernel)(const qint64*, qint64*, int, qint64);
+
+static prefixSumKernel selectPrefixSum() {
+#ifdef FLUFFEL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return prefixSumAVX2;
+    }
+
+    return prefixSumSSE2;
+#else
+    return prefixSumScalar;
+#endif
+}
+
+qint64 FluffelTimeColumn::prefixSum(const qint64* in, qint64* out, int count, qint64 start) {
+    static const prefixSumKernel kernel = selectPrefixSum();
+    return kernel(in, out, count, start);
+}
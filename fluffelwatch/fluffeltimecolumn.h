@@ -0,0 +1,45 @@
+#ifndef FLUFFELTIMECOLUMN_H
+#define FLUFFELTIMECOLUMN_H
+
+#include <QtGlobal>
+
+/* Column of times (in ns), e.g. the run time of every segment. The memory is
+ * aligned to FluffelTimeColumn::alignment, so the vector loads of the kernel
+ * below never cross a cache line when it runs over a whole column. These are
+ * unaligned loads, so it also works on parts of a column that start anywhere.
+ * Columns only grow; shrinking keeps the memory. */
+class FluffelTimeColumn {
+  public:
+    FluffelTimeColumn();
+    ~FluffelTimeColumn();
+
+    static const int alignment = 32;
+
+    /* New elements are zero */
+    void resize(int count);
+    void append(qint64 value);
+    void clear();
+
+    int size() const;
+    qint64 *data();
+    const qint64 *data() const;
+
+    qint64 &operator[](int index);
+    qint64 operator[](int index) const;
+    qint64 &last();
+
+    /* Prefix sum over whole columns (or count elements of them): out[i] = start +
+     * in[0] + ... + in[i]; returns the last sum. The arrays may be the same (in
+     * place), but must not overlap otherwise. Uses AVX2 or SSE2 if the CPU has
+     * it, or else a plain loop. */
+    static qint64 prefixSum(const qint64 *in, qint64 *out, int count, qint64 start = 0);
+
+  private:
+    Q_DISABLE_COPY(FluffelTimeColumn)
+
+    qint64 *values;
+    int count;
+    int capacity;
+};
+
+#endif // FLUFFELTIMECOLUMN_H
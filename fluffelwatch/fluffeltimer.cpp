@@ -1,19 +1,46 @@
 #include "fluffeltimer.h"
 
-FluffelTimer::FluffelTimer() {
+#include <string.h>
+
+const qint64 FluffelTimer::nsecsPerMSec = 1000000;
+
+FluffelTimer::FluffelTimer(FluffelClock* clock) {
+    this->clock = clock;
+    startTime = -1;
+    pausedTime = 0;
     refPauseTime = -1;
+    refChangeTime = 0;
 }
 
 FluffelTimer::~FluffelTimer() {
 
 }
 
+void FluffelTimer::setClock(FluffelClock* value) {
+    /* Times of different clocks cannot be compared */
+    clock = value;
+    invalidate();
+}
+
+FluffelClock* FluffelTimer::getClock() const {
+    return clock;
+}
+
 void FluffelTimer::start() {
     /* Reset pause and start timer */
     pausedTime = 0;
     refPauseTime = -1;
+    refChangeTime = 0;
+
+    startTime = clock->nsecs();
+}
+
+void FluffelTimer::invalidate() {
+    startTime = -1;
+}
 
-    QElapsedTimer::start();
+bool FluffelTimer::isValid() const {
+    return (startTime != -1);
 }
 
 void FluffelTimer::pause() {
@@ -23,6 +50,7 @@ void FluffelTimer::pause() {
 
     /* Save the elapsed time as a reference */
     refPauseTime = elapsed();
+    refChangeTime = refPauseTime;
 }
 
 bool FluffelTimer::isPaused() const {
@@ -35,7 +63,8 @@ void FluffelTimer::resume() {
     }
 
     /* Add the paused time to the total time paused */
-    pausedTime += elapsed() - refPauseTime;
+    refChangeTime = elapsed();
+    pausedTime += refChangeTime - refPauseTime;
     refPauseTime = -1;
 }
 
@@ -58,43 +87,178 @@ qint64 FluffelTimer::elapsed_with_pause() const {
     return elapsed() - pausedTime;
 }
 
+void FluffelTimer::startAt(qint64 timestamp) {
+    start();
+
+    /* The timer was actually started some time ago (but not in the future) */
+    if (timestamp < startTime) {
+        startTime = timestamp;
+    }
+}
+
+void FluffelTimer::pauseAt(qint64 timestamp) {
+    if ((refPauseTime > -1) || (!isValid())) {
+        return;
+    }
+
+    refPauseTime = elapsedAt(timestamp);
+    refChangeTime = refPauseTime;
+}
+
+void FluffelTimer::resumeAt(qint64 timestamp) {
+    if ((refPauseTime == -1) || (!isValid())) {
+        return;
+    }
+
+    /* The resume time cannot be before the pause since refChangeTime is the pause time */
+    refChangeTime = elapsedAt(timestamp);
+    pausedTime += refChangeTime - refPauseTime;
+    refPauseTime = -1;
+}
+
+qint64 FluffelTimer::elapsed_with_pause_at(qint64 timestamp) const {
+    if (refPauseTime != -1) {
+        return refPauseTime - pausedTime;
+    }
+
+    return elapsedAt(timestamp) - pausedTime;
+}
+
+void FluffelTimer::setElapsed(qint64 time) {
+    if (!isValid()) {
+        return;
+    }
+
+    if (refPauseTime != -1) {
+        pausedTime = refPauseTime - time;
+    } else {
+        pausedTime = elapsed() - time;
+    }
+}
+
+void FluffelTimer::setElapsedAt(qint64 time, qint64 timestamp) {
+    if (!isValid()) {
+        return;
+    }
+
+    /* The time that passed since the event is kept */
+    if (refPauseTime != -1) {
+        pausedTime = refPauseTime - time;
+    } else {
+        pausedTime = elapsedAt(timestamp) - time;
+    }
+}
+
 QString FluffelTimer::toString() const {
     /* Invalidate times */
     if (!isValid()) {
         return QString("00:00:00.00");
     }
 
-    /* Transfer the milliseconds qint64 into a
+    /* Transfer the nanoseconds qint64 into a
      * string. */
     return FluffelTimer::getStringFromTime(elapsed_with_pause());
 }
 
 QString FluffelTimer::getStringFromTime(qint64 time) {
-    /* Transfer the milliseconds qint64 into a string. */
-    int hours = time / 3600000;                                                      /* 1 hour has 3 600 000 msec */
-    int minutes = (time - hours * 3600000) / 60000;                                  /* 1 minutes has 60 000 msec */
-    int seconds = (time - hours * 3600000 - minutes * 60000) / 1000;                 /* 1 second has 1 000 msec */
-    int per_sec = (time - hours * 3600000 - minutes * 60000 - seconds * 1000) / 10;  /* a 100th of a second has 10 msecs */
-
-    return QString::asprintf("%02d:%02d:%02d.%02d", hours, minutes, seconds, per_sec);
+    QChar buffer[maxStringLength];
+    return QString(buffer, formatTime(time, buffer));
 }
 
 QString FluffelTimer::getStringFromTimeDiff(qint64 timediff) {
-    /* Transfer a time difference into a string. First we convert it to
-     * a normal time string */
-    QString timestr = FluffelTimer::getStringFromTime(qAbs(timediff));
+    QChar buffer[maxStringLength];
+    return QString(buffer, formatTimeDiff(timediff, buffer));
+}
+
+int FluffelTimer::formatTime(qint64 time, QChar* buffer) {
+    /* Transfer the nanoseconds qint64 into a string. Only a 100th of a second is shown,
+     * so the time is cut down to these first. */
+    QChar *out = buffer;
+    qint64 centis = time / 10000000;                /* a 100th of a second has 10 000 000 nsec */
+
+    if (centis < 0) {
+        *out++ = QLatin1Char('-');
+        centis = -centis;
+    }
+
+    qint64 hours = centis / 360000;                 /* 1 hour has 360 000 100ths of a second */
+    int minutes = (centis / 6000) % 60;             /* 1 minute has 6 000 100ths of a second */
+    int seconds = (centis / 100) % 60;
+    int per_sec = centis % 100;
+
+    /* Hours have at least two digits, but can have more */
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = '0' + hours % 10;
+        hours /= 10;
+    } while ((hours > 0) || (count < 2));
+
+    while (count > 0) {
+        *out++ = QLatin1Char(digits[--count]);
+    }
+
+    const int fields[3] = { minutes, seconds, per_sec };
+    const char separators[3] = { ':', ':', '.' };
+
+    for (int i = 0; i < 3; ++i) {
+        *out++ = QLatin1Char(separators[i]);
+        *out++ = QLatin1Char('0' + fields[i] / 10);
+        *out++ = QLatin1Char('0' + fields[i] % 10);
+    }
+
+    return out - buffer;
+}
+
+int FluffelTimer::formatTimeDiff(qint64 timediff, QChar* buffer) {
+    /* Transfer a time difference into a string. The minus here is a real
+     * minus (U+2212) not a dash! */
+    buffer[0] = (timediff >= 0) ? QChar('+') : QChar(0x2212);
+
+    /* Then the normal time string, but without hours and/or minutes if the
+     * timediff is too low */
+    int length = formatTime(qAbs(timediff), buffer + 1);
 
-    /* Remove hours and/or minutes if the timediff is too low */
     int remove = 0;
-    if (qAbs(timediff) < 60000) {
+    if (qAbs(timediff) < Q_INT64_C(60000000000)) {
         remove = 6;
-    } else if (qAbs(timediff < 3600000)) {
+    } else if (qAbs(timediff) < Q_INT64_C(3600000000000)) {
         remove = 3;
     }
-    /* The minus here is a real minus (U+2212) not a dash! */
-    return (timediff >= 0 ? "+" : "−") + timestr.mid(remove);
+
+    memmove(buffer + 1, buffer + 1 + remove, (length - remove) * sizeof(QChar));
+    return length - remove + 1;
+}
+
+void FluffelTimer::formatTime(qint64 time, QString& target) {
+    /* Shrinking a string keeps its memory, so this only allocates the first time */
+    if (target.capacity() < maxStringLength) {
+        target.reserve(maxStringLength);
+    }
+
+    target.resize(maxStringLength);
+    target.resize(formatTime(time, target.data()));
+}
+
+void FluffelTimer::formatTimeDiff(qint64 timediff, QString& target) {
+    if (target.capacity() < maxStringLength) {
+        target.reserve(maxStringLength);
+    }
+
+    target.resize(maxStringLength);
+    target.resize(formatTimeDiff(timediff, target.data()));
+}
+
+qint64 FluffelTimer::monotonicNSecs() {
+    return FluffelClock::monotonic()->nsecs();
 }
 
 qint64 FluffelTimer::elapsed() const {
-    return QElapsedTimer::elapsed();
+    return clock->nsecs() - startTime;
+}
+
+qint64 FluffelTimer::elapsedAt(qint64 timestamp) const {
+    /* Events cannot change the past before the last start/pause/resume and cannot
+     * lie in the future. */
+    return qBound(refChangeTime, timestamp - startTime, elapsed());
 }
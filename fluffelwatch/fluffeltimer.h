@@ -1,35 +1,87 @@
 #ifndef FLUFFELTIMER_H
 #define FLUFFELTIMER_H
 
-#include <QElapsedTimer>
 #include <QString>
 
-class FluffelTimer : public QElapsedTimer {
+#include "fluffelclock.h"
+
+/* Timer that can be paused and resumed. All times are kept in nanoseconds of
+ * its clock (usually the monotonic system clock), so pauses are added up as
+ * exact spans and no rounding error piles up over many pauses. */
+class FluffelTimer {
   public:
-    FluffelTimer();
+    explicit FluffelTimer(FluffelClock *clock = FluffelClock::monotonic());
     ~FluffelTimer();
 
-    /* Pause/Continue functions */
+    /* Changes the clock of the timer; this invalidates the timer */
+    void setClock(FluffelClock *value);
+    FluffelClock *getClock() const;
+
+    /* Start/Pause/Continue functions */
     void start();
+    void invalidate();
+    bool isValid() const;
     void pause();
     bool isPaused() const;
     void resume();
     qint64 restart();
 
-    qint64 elapsed_with_pause() const;        
-    QString toString() const;    
+    /* Elapsed time without the pauses in ns */
+    qint64 elapsed_with_pause() const;
+    QString toString() const;
+
+    /* The same functions, but for an event that happened at the given time of the
+     * clock (in ns, usually monotonicNSecs). Times before the last start,
+     * pause or resume are moved to that point and times in the future to now.
+     * startAt takes any time in the past, so callers must bound timestamps that
+     * come from outside (see FluffelIPCThread::maxEventAge). */
+    void startAt(qint64 timestamp);
+    void pauseAt(qint64 timestamp);
+    void resumeAt(qint64 timestamp);
+    qint64 elapsed_with_pause_at(qint64 timestamp) const;
 
-    /* Static function to convert a qint64 into a string */
+    /* Changes the paused time so that elapsed_with_pause() returns the given time (in ns),
+     * now or at the given time of the clock */
+    void setElapsed(qint64 time);
+    void setElapsedAt(qint64 time, qint64 timestamp);
+
+    /* Static functions to convert a time in ns into a string (with centiseconds) */
     static QString getStringFromTime(qint64 time);
     static QString getStringFromTimeDiff(qint64 timediff);
 
+    /* The same without allocating memory: the time is written into the buffer, which
+     * must hold maxStringLength characters, and the length is returned. The versions
+     * with a string reuse its memory (once it is large enough). */
+    static const int maxStringLength = 24;
+
+    static int formatTime(qint64 time, QChar *buffer);
+    static int formatTimeDiff(qint64 timediff, QChar *buffer);
+    static void formatTime(qint64 time, QString &target);
+    static void formatTimeDiff(qint64 timediff, QString &target);
+
+    /* Current time of the monotonic system clock (CLOCK_MONOTONIC) in nanoseconds */
+    static qint64 monotonicNSecs();
+
+    /* Conversion between ns and ms (e.g. for the split files) */
+    static const qint64 nsecsPerMSec;
 
   private:
+    FluffelClock *clock;
+
+    /* Start time on the clock; -1 if the timer is not valid */
+    qint64 startTime;
+
     /* This holds the total amount of pause we did */
     qint64 pausedTime;
     qint64 refPauseTime;
 
-    /* Make elapsed private so it cannot be called from the outside */
+    /* Time of the last start, pause or resume */
+    qint64 refChangeTime;
+
+    /* Converts a monotonic timestamp into the elapsed time */
+    qint64 elapsedAt(qint64 timestamp) const;
+
+    /* Elapsed time including the pauses */
     qint64 elapsed() const;
 };
 
@@ -0,0 +1,67 @@
+#-------------------------------------------------
+#
+# Sources of Fluffelwatch without main.cpp, shared with the tools that
+# use the main window (e.g. fluffelpaintbench)
+#
+#-------------------------------------------------
+
+QT       += core gui network gui-private
+
+QMAKE_LFLAGS += -no-pie
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+INCLUDEPATH += $$PWD
+
+LIBS += -L/usr/X11/lib -lX11 -lrt
+
+SOURCES += \
+    $$PWD/mainwindow.cpp \
+    $$PWD/splitdata.cpp \
+    $$PWD/fluffeltimer.cpp \
+    $$PWD/qxt/qxtglobalshortcut_x11.cpp \
+    $$PWD/qxt/qxtglobalshortcut.cpp \
+    $$PWD/fluffelipcthread.cpp \
+    $$PWD/icondisplay.cpp \
+    $$PWD/timecontroller.cpp \
+    $$PWD/fluffelstreamreader.cpp \
+    $$PWD/fluffelstatemerger.cpp \
+    $$PWD/fluffelsharedstate.cpp \
+    $$PWD/fluffelpublisher.cpp \
+    $$PWD/fluffeljournal.cpp \
+    $$PWD/fluffelclock.cpp \
+    $$PWD/fluffelglyphatlas.cpp \
+    $$PWD/fluffelframestats.cpp \
+    $$PWD/fluffeltheme.cpp \
+    $$PWD/fluffeltimecolumn.cpp \
+    $$PWD/fluffelhistory.cpp
+
+HEADERS += \
+    $$PWD/mainwindow.h \
+    $$PWD/splitdata.h \
+    $$PWD/fluffeltimer.h \
+    $$PWD/qxt/qxtglobalshortcut_p.h \
+    $$PWD/qxt/qxtglobalshortcut.h \
+    $$PWD/qxt/xcbkeyboard.h \
+    $$PWD/fluffelipcthread.h \
+    $$PWD/icondisplay.h \
+    $$PWD/timecontroller.h \
+    $$PWD/fluffeleventqueue.h \
+    $$PWD/fluffelprotocol.h \
+    $$PWD/fluffelstreamreader.h \
+    $$PWD/fluffelstatemerger.h \
+    $$PWD/fluffelsharedstate.h \
+    $$PWD/fluffelpublisher.h \
+    $$PWD/fluffeljournal.h \
+    $$PWD/fluffelclock.h \
+    $$PWD/fluffelglyphatlas.h \
+    $$PWD/fluffelframestats.h \
+    $$PWD/fluffeltheme.h \
+    $$PWD/fluffeltimecolumn.h \
+    $$PWD/fluffelhistory.h
+
+FORMS += \
+    $$PWD/mainwindow.ui
+
+RESOURCES += \
+    $$PWD/fluffelwatch.qrc
@@ -4,12 +4,6 @@
 #
 #-------------------------------------------------
 
-QT       += core gui network gui-private
-
-QMAKE_LFLAGS += -no-pie
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
 TARGET = fluffelwatch
 TEMPLATE = app
 
@@ -24,32 +18,7 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-LIBS += -L/usr/X11/lib -lX11
+include(fluffelwatch.pri)
 
 SOURCES += \
-        main.cpp \
-        mainwindow.cpp \
-    splitdata.cpp \
-    fluffeltimer.cpp \
-    qxt/qxtglobalshortcut_x11.cpp \
-    qxt/qxtglobalshortcut.cpp \
-    fluffelipcthread.cpp \
-    icondisplay.cpp \
-    timecontroller.cpp
-
-HEADERS += \
-        mainwindow.h \
-    splitdata.h \
-    fluffeltimer.h \
-    qxt/qxtglobalshortcut_p.h \
-    qxt/qxtglobalshortcut.h \
-    qxt/xcbkeyboard.h \
-    fluffelipcthread.h \
-    icondisplay.h \
-    timecontroller.h
-
-FORMS += \
-        mainwindow.ui
-
-RESOURCES += \
-    fluffelwatch.qrc
+        main.cpp
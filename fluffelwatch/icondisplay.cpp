@@ -1,13 +1,12 @@
 #include "icondisplay.h"
 
 /* This is the maximum number of icons allowed */
-const int IconDisplay::maxIcons = 32;
+const int IconDisplay::maxIcons = 4096;
 
 
 IconDisplay::IconDisplay() {
     lines = 0;
     columns = 0;
-    states = 0;
 }
 
 IconDisplay::~IconDisplay() {
@@ -15,10 +14,10 @@ IconDisplay::~IconDisplay() {
 }
 
 void IconDisplay::loadFromFile(const QString& filename) {
-    /* Clear all icons we had before and reserve memory for the maximum number of
-     * icons. */
+    /* Clear all icons we had before; the list grows with the icons defined */
     icons.clear();
-    icons.resize(maxIcons);
+    states.clear();
+    atlasRect = QRect();
 
     /* Get some data from this filename, i.e. the directory (important for loading
      * the icon files). */
@@ -72,41 +71,73 @@ void IconDisplay::loadFromFile(const QString& filename) {
                 continue;
             }
 
+            if (icons.size() < fields[0].toInt()) {
+                icons.resize(fields[0].toInt());
+            }
+
             icons[fields[0].toInt()-1] = icon;
         }
     }
 
     file.close();
+
+    /* Every icon has a state */
+    states.resize(icons.size());
 }
 
-void IconDisplay::setStates(const quint32 value) {
+void IconDisplay::setStates(const QBitArray& value) {
     states = value;
+    states.resize(icons.size());
+}
+
+void IconDisplay::setStates(const quint32 value) {
+    states.fill(false);
+
+    for (int i = 0; i < qMin(states.size(), 32); ++i) {
+        states.setBit(i, value & (1u << i));
+    }
+}
+
+const QBitArray& IconDisplay::getStates() const {
+    return states;
+}
+
+quint32 IconDisplay::getFirstStates() const {
+    quint32 value = 0;
+
+    for (int i = 0; i < qMin(states.size(), 32); ++i) {
+        if (states.testBit(i)) {
+            value |= (1u << i);
+        }
+    }
+
+    return value;
 }
 
 void IconDisplay::showIcon(const quint32 pos) {
-    if (pos < maxIcons) {
-        states |= (1 << pos);
+    if (pos < static_cast<quint32>(states.size())) {
+        states.setBit(pos);
     }
 }
 
 void IconDisplay::hideIcon(const quint32 pos) {
-    if (pos < maxIcons) {
-        states &= ~(1 << pos);
+    if (pos < static_cast<quint32>(states.size())) {
+        states.clearBit(pos);
     }
 }
 
 void IconDisplay::toggleIcon(const quint32 pos) {
-    if (pos < maxIcons) {
-        states ^= (1 << pos);
+    if (pos < static_cast<quint32>(states.size())) {
+        states.toggleBit(pos);
     }
 }
 
 void IconDisplay::showAllIcons() {
-    setStates(0xFFFFFFFF);
+    states.fill(true);
 }
 
 void IconDisplay::hideAllIcons() {
-    setStates(0);
+    states.fill(false);
 }
 
 void IconDisplay::paint(QPainter& painter, const QRect& rect) {
@@ -115,16 +146,86 @@ void IconDisplay::paint(QPainter& painter, const QRect& rect) {
         return;
     }
 
-    /* Calculate the size of one icon */
-    int iconSize = qMin(rect.width() / columns, rect.height() / lines);
-    int maxDisplay = qMin(columns * lines, maxIcons);
+    updateAtlas(rect, painter.device()->devicePixelRatioF());
 
     /* Draw all icons */
-    for(int i = 0; i < maxDisplay; ++i) {
-        if (!icons[i].isNull() && (states & (1 << i))) {
-            painter.drawPixmap(rect.left() + i % columns * iconSize,
-                               rect.top() + i / columns * iconSize,
-                               iconSize, iconSize, icons[i]);
+    for (int i = 0; i < getVisibleIcons(); ++i) {
+        paintCell(painter, rect, i);
+    }
+}
+
+void IconDisplay::paintChanged(QPainter& painter, const QRect& rect, const QBitArray& previous) {
+    if (columns == 0 || lines == 0) {
+        return;
+    }
+
+    updateAtlas(rect, painter.device()->devicePixelRatioF());
+
+    for (int i = 0; i < getVisibleIcons(); ++i) {
+        if ((i >= previous.size()) || (previous.testBit(i) != states.testBit(i))) {
+            paintCell(painter, rect, i);
         }
     }
 }
+
+QRegion IconDisplay::getChangedRegion(const QRect& rect, const QBitArray& previous) const {
+    QRegion region;
+
+    if (columns == 0 || lines == 0) {
+        return region;
+    }
+
+    for (int i = 0; i < getVisibleIcons(); ++i) {
+        if ((i >= previous.size()) || (previous.testBit(i) != states.testBit(i))) {
+            region += getCellRect(rect, i);
+        }
+    }
+
+    return region;
+}
+
+void IconDisplay::updateAtlas(const QRect& rect, qreal ratio) {
+    if ((rect == atlasRect) && (ratio == atlasRatio)) {
+        return;
+    }
+
+    atlasRect = rect;
+    atlasRatio = ratio;
+
+    /* Calculate the size of one icon */
+    iconSize = qMin(rect.width() / columns, rect.height() / lines);
+
+    /* Scale every icon once (smoothly) into its cell of the grid */
+    atlas = QPixmap(QSize(columns * iconSize, lines * iconSize) * ratio);
+    atlas.setDevicePixelRatio(ratio);
+    atlas.fill(Qt::transparent);
+
+    QPainter painter(&atlas);
+    for (int i = 0; i < getVisibleIcons(); ++i) {
+        if (!icons[i].isNull()) {
+            QPixmap scaled = icons[i].scaled(QSize(iconSize, iconSize) * ratio, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            scaled.setDevicePixelRatio(ratio);
+            painter.drawPixmap(getCellRect(QRect(), i).topLeft(), scaled);
+        }
+    }
+}
+
+int IconDisplay::getVisibleIcons() const {
+    return qMin(columns * lines, icons.size());
+}
+
+QRect IconDisplay::getCellRect(const QRect& rect, int index) const {
+    return QRect(rect.left() + index % columns * iconSize,
+                 rect.top() + index / columns * iconSize,
+                 iconSize, iconSize);
+}
+
+void IconDisplay::paintCell(QPainter& painter, const QRect& rect, int index) {
+    if (icons[index].isNull() || !states.testBit(index)) {
+        return;
+    }
+
+    QRect source = getCellRect(QRect(), index);
+    painter.drawPixmap(getCellRect(rect, index).topLeft(), atlas,
+                       QRect(source.topLeft() * atlasRatio, source.size() * atlasRatio));
+}
@@ -1,10 +1,12 @@
 #ifndef ICONDISPLAY_H
 #define ICONDISPLAY_H
 
+#include <QBitArray>
 #include <QFile>
 #include <QFileInfo>
 #include <QPainter>
 #include <QPixmap>
+#include <QRegion>
 #include <QStringList>
 #include <QTextStream>
 
@@ -20,8 +22,15 @@ class IconDisplay {
      * and the grid size. */
     void loadFromFile(const QString &filename);
 
-    /* Sets the states of the icons by bits (1 = on, 0 = off) */
+    /* Sets the states of the icons (true/1 = on, false/0 = off). Icons without a
+     * state are off. The version with bits is for the 32 icons of the legacy
+     * protocol. */
+    void setStates(const QBitArray &value);
     void setStates(const quint32 value);
+    const QBitArray &getStates() const;
+
+    /* The states of the first 32 icons as bits */
+    quint32 getFirstStates() const;
 
     void showIcon(const quint32 pos);
     void hideIcon(const quint32 pos);
@@ -33,6 +42,12 @@ class IconDisplay {
     /* Paint the icons to the given rectangle */
     void paint(QPainter &painter, const QRect &rect);
 
+    /* Paints only the cells of the icons whose state differs from the given states;
+     * the background of the cells must be painted already. getChangedRegion returns
+     * the area of these cells. */
+    void paintChanged(QPainter &painter, const QRect &rect, const QBitArray &previous);
+    QRegion getChangedRegion(const QRect &rect, const QBitArray &previous) const;
+
   private:
     /* A list of pixmaps that represent the icons */
     QVector<QPixmap> icons;
@@ -41,8 +56,21 @@ class IconDisplay {
     int lines;
     int columns;
 
-    /* The current state of all icons as a handy 32bit integer */
-    quint32 states;
+    /* The current state of all icons */
+    QBitArray states;
+
+    /* All icons scaled to the size of a cell once and placed in the atlas as in
+     * the grid, so painting an icon is a plain copy. The atlas is made again if
+     * the rectangle or the device pixel ratio changes. */
+    QPixmap atlas;
+    QRect atlasRect;
+    qreal atlasRatio = 0.0;
+    int iconSize = 0;
+
+    void updateAtlas(const QRect &rect, qreal ratio);
+    int getVisibleIcons() const;
+    QRect getCellRect(const QRect &rect, int index) const;
+    void paintCell(QPainter &painter, const QRect &rect, int index);
 };
 
 #endif // ICONDISPLAY_H
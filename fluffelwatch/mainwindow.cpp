@@ -1,36 +1,79 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
+MainWindow::MainWindow(QWidget *parent, const QString &configFile, bool headless) : QMainWindow(parent), ui(new Ui::MainWindow) {
+    this->headless = headless;
+
     /* Setup UI with a border less window and an action context menu */
     ui->setupUi(this);
     setWindowFlags(Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint);
 
     setupContextMenu();
-    setupGlobalShortcuts();
+
+    /* Rendering without a display must not change the history of the split file */
+    if (headless) {
+        data.setHistoryEnabled(false);
+    }
 
     /* Read in settings from an conf-file */
-    settings = new QSettings("fluffelwatch.conf", QSettings::NativeFormat);
+    settings = new QSettings(configFile, QSettings::NativeFormat);
     readSettings();
 
     /* Calculate the region and window size */
     calculateRegionSizes();
 
-    /* Start timer every 10 msec (can do faster timers, but it costs CPU load!) */
-    timerID = startTimer(10, Qt::PreciseTimer);
+    /* Only painting from here on */
+    if (headless) {
+        return;
+    }
+
+    setupGlobalShortcuts();
+
+    /* Apply changes of the fonts and colors right away */
+    setupSettingsWatcher();
+
+    /* Restore the last run if Fluffelwatch crashed and start recording this one */
+    setupJournal();
 
     /* Start the thread for managing IPC to allow external programs to
-     * change section number and iconstates */
+     * change section number and iconstates. The thread signals new
+     * events as soon as they arrive. */
+    connect(&ipcthread, &FluffelIPCThread::eventsAvailable, this, &MainWindow::onIPCEvents, Qt::QueuedConnection);
     ipcthread.start();
+
+    /* Overlays and other tools can follow the state through a second socket */
+    if (publishing) {
+        publisher.start();
+    }
 }
 
 MainWindow::~MainWindow() {
-    /* Request exit of the thread and give it some time to exit */
-    ipcthread.requestInterruption();
-    QThread::msleep(ipcthread.timeout * 2);
+    /* Report the frame timing of this session */
+    if (frameStats.getCount(FluffelFrameStats::paintDuration) > 0) {
+        QStringList lines = frameStats.summary();
+        for (int i = 0; i < lines.size(); ++i) {
+            qDebug("%s", lines[i].toUtf8().constData());
+        }
+
+        for (int i = 0; i < FluffelFrameStats::measureCount; ++i) {
+            qDebug("%s", frameStats.histogram(static_cast<FluffelFrameStats::measure>(i)).toUtf8().constData());
+        }
+    }
+
+    /* Stop the thread and wait until it has closed its socket */
+    ipcthread.stop();
+    ipcthread.wait();
 
-    /* Kill the timer we started */
-    killTimer(timerID);
+    publisher.stop();
+    publisher.wait();
+
+    /* Closed properly, so the journal is not needed anymore */
+    journal.close();
+
+    /* Kill the timer if it runs */
+    if (timerID != 0) {
+        killTimer(timerID);
+    }
 
     /* Destroy everything */
     delete ui;
@@ -63,79 +106,433 @@ void MainWindow::mouseReleaseEvent(QMouseEvent* event) {
 }
 
 void MainWindow::paintEvent(QPaintEvent* event) {
-    Q_UNUSED(event)
+    /* How long the repaint waited in the event loop */
+    qint64 start = FluffelTimer::monotonicNSecs();
+    if (repaintRequested > 0) {
+        frameStats.add(FluffelFrameStats::repaintLatency, start - repaintRequested);
+        repaintRequested = 0;
+    }
 
     QMainWindow::paintEvent(event);
 
-    QPainter painter(this);
+    {
+        QPainter painter(this);
+        paintFrame(painter, event->rect());
+    }
+
+    frameStats.add(FluffelFrameStats::paintDuration, FluffelTimer::monotonicNSecs() - start);
+}
+
+void MainWindow::renderFrame(QImage& image, bool full) {
+    QRect dirty = rect();
+
+    /* A tick only repaints the timers and the current segment */
+    if (!full) {
+        dirty = rectRealTimer.united(rectIngameTimer);
+
+        int currentLine = getCurrentSegmentLine();
+        if (currentLine > -1) {
+            dirty = dirty.united(getSegmentLineRect(currentLine));
+        }
+    }
+
+    QPainter painter(&image);
+    painter.setClipRect(dirty);
+    paintFrame(painter, dirty);
+}
+
+void MainWindow::paintFrame(QPainter& painter, const QRect& dirty) {
+    /* Paint the static content again only if it changed */
+    updateStaticLayer();
+
     painter.setRenderHint(QPainter::Antialiasing);
     painter.testRenderHint(QPainter::TextAntialiasing);
 
-    /* Fill background and draw all elements */
-    painter.setBrush(backgroundBrush);
-    painter.drawRect(this->rect());
+    /* Copy the static content of the dirty area and draw the timers on top */
+    qreal ratio = staticLayer.devicePixelRatio();
+    painter.drawPixmap(dirty, staticLayer, QRect(dirty.topLeft() * ratio, dirty.size() * ratio));
+
+    paintDynamicElements(painter, dirty);
+
+    if (showFrameStats && regionFrameStats.intersects(dirty)) {
+        paintFrameStats(painter);
+    }
+}
 
-    paintAllElements(painter);
+void MainWindow::paintFrameStats(QPainter& painter) {
+    painter.fillRect(regionFrameStats, QColor(0, 0, 0, 192));
+
+    QStringList lines = frameStats.summary();
+    int lineHeight = regionFrameStats.height() / lines.size();
+
+    painter.setFont(frameStatsFont);
+    painter.setPen(Qt::white);
+
+    for (int i = 0; i < lines.size(); ++i) {
+        painter.drawText(QRect(regionFrameStats.left(), regionFrameStats.top() + i * lineHeight, regionFrameStats.width(), lineHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter, lines[i]);
+    }
 }
 
 void MainWindow::timerEvent(QTimerEvent* event) {
     Q_UNUSED(event)
 
-    /* Process new information from thread if available */
-    if (ipcthread.dataChanged()) {
-        /* Get the newest data */
-        FluffelIPCThread::listenerData tempData = ipcthread.getData();
+    qint64 now = FluffelTimer::monotonicNSecs();
+    if (lastTick > 0) {
+        frameStats.add(FluffelFrameStats::tickInterval, now - lastTick);
+    }
+    lastTick = now;
 
-        /* Send icon states to the icon manager */
-        icons.setStates(tempData.iconstates);
+    /* Check for a new state in shared memory; this is just a memory read if nothing changed */
+    FluffelIPCThread::listenerEvent sharedEvent;
+    if (sharedState.poll(sharedEvent)) {
+        processIPCEvent(sharedEvent);
+        onStateChanged();
+    }
 
-        qDebug("New state: section = %d, states = 0x%08X, timercontrol = %d", tempData.section, tempData.iconstates, tempData.timercontrol);
+    /* Update the display; only the timers change on each tick */
+    updateDynamicRegions();
+}
 
-        /* If the timers are NOT running yet, then only react to the autostart signal and only if the user wants that */
-        if (autostartstop && !timeControl.areBothTimerValid() && tempData.timercontrol == FluffelIPCThread::timeControlStart) {
-            qDebug("Got start signal, resetting and starting both timers.");
-            timeControl.resetBothTimer();
-            timeControl.restartBothTimer();
-        }
+void MainWindow::showEvent(QShowEvent* event) {
+    QMainWindow::showEvent(event);
+    updateRefreshTimer();
+}
+
+void MainWindow::hideEvent(QHideEvent* event) {
+    QMainWindow::hideEvent(event);
+    updateRefreshTimer();
+}
 
-        /* If the timers are running and the user wants it, react to the autostop signal */
-        else if (autostartstop && timeControl.isAnyTimerRunning() && tempData.timercontrol == FluffelIPCThread::timeControlStop) {
-            qDebug("Got stop signal. Stopping both timers and do a split.");
-            timeControl.pauseBothTimer();
+void MainWindow::changeEvent(QEvent* event) {
+    QMainWindow::changeEvent(event);
 
-            displaySegments.clear();
-            int remains = data.split(timeControl.elapsedPreferredTime());
-            int segments = data.getCurrentSegments(displaySegments, segmentLines);
-            qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
-        }
+    if (event->type() == QEvent::WindowStateChange) {
+        updateRefreshTimer();
+    }
+}
+
+int MainWindow::getRefreshInterval() const {
+    qreal rate = refreshRate;
+
+    /* Use the refresh rate of the screen the window is on if none is set */
+    if (rate <= 0) {
+        QScreen *screen = (windowHandle() != nullptr) ? windowHandle()->screen() : QGuiApplication::primaryScreen();
+        rate = (screen != nullptr) ? qMin(screen->refreshRate(), 100.0) : 100.0;
+    }
+
+    return qMax(1, qRound(1000.0 / rate));
+}
+
+void MainWindow::updateRefreshTimer() {
+    bool running = isRunning() && isVisible() && !isMinimized();
+    int interval = (running || sharedState.isOpen()) ? getRefreshInterval() : 0;
+
+    if (interval == timerInterval) {
+        return;
+    }
+
+    if (timerID != 0) {
+        killTimer(timerID);
+        timerID = 0;
+    }
+
+    if (interval > 0) {
+        timerID = startTimer(interval, Qt::PreciseTimer);
+    }
+
+    timerInterval = interval;
+
+    /* The time without ticks is not an interval */
+    lastTick = 0;
 
-        /* Autosplits enabled, so split if the section number changes */
-        if (autosplit && (tempData.section > data.getCurrentSection())) {
-            qDebug("Do an autosplit to section %d", tempData.section);
+    /* Show the times the timers stopped at */
+    update();
+}
+
+void MainWindow::onStateChanged() {
+    /* Let subscribers know and tick only as long as needed */
+    publishState();
+    updateRefreshTimer();
+}
+
+void MainWindow::onIPCEvents() {
+    /* Take all events, so no transition is lost even if several arrive at once */
+    FluffelIPCThread::listenerEvent event;
+    while (ipcthread.takeEvent(event)) {
+        processIPCEvent(event);
+    }
+
+    /* Report if the queue ran full in the meantime */
+    quint64 overflows = ipcthread.getOverflowCount();
+    if (overflows != ipcOverflows) {
+        qDebug("IPC event queue was full %llu time(s) so far.", overflows);
+        ipcOverflows = overflows;
+    }
+
+    onStateChanged();
+
+    /* Show the new state right away */
+    updateDynamicRegions();
+}
+
+void MainWindow::processIPCEvent(const FluffelIPCThread::listenerEvent& event) {
+    /* Commands of the version 2 protocol are handled separately */
+    if (event.type != FluffelIPCThread::eventState) {
+        processIPCCommand(event);
+        return;
+    }
+
+    /* All timer changes are done at the time of the event and not at the time
+     * it gets processed here. */
+    const FluffelIPCThread::listenerData &newdata = event.data;
+
+    /* Send icon states to the icon manager */
+    icons.setStates(newdata.iconstates);
+
+    qDebug("New state: section = %d, states = 0x%08X, timercontrol = %d", newdata.section, newdata.iconstates, newdata.timercontrol);
+
+    /* If the timers are NOT running yet, then only react to the autostart signal and only if the user wants that */
+    if (autostartstop && !timeControl.areBothTimerValid() && newdata.timercontrol == FluffelProtocol::timeControlStart) {
+        qDebug("Got start signal, resetting and starting both timers.");
+        timeControl.resetBothTimer();
+        timeControl.startBothTimerAt(event.timestamp);
+    }
+
+    /* If the timers are running and the user wants it, react to the autostop signal */
+    else if (autostartstop && timeControl.isAnyTimerRunning() && newdata.timercontrol == FluffelProtocol::timeControlStop) {
+        qDebug("Got stop signal. Stopping both timers and do a split.");
+        timeControl.pauseBothTimerAt(event.timestamp);
+
+        int remains = data.split(timeControl.elapsedPreferredTimeAt(event.timestamp));
+        int segments = updateDisplaySegments();
+        qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
+    }
+
+    /* Autosplits enabled, so split if the section number changes */
+    if (autosplit && (newdata.section > data.getCurrentSection())) {
+        qDebug("Do an autosplit to section %d", newdata.section);
+
+        int remains = data.splitToSection(newdata.section, timeControl.elapsedPreferredTimeAt(event.timestamp));
+        int segments = updateDisplaySegments();
+        qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
+    }
+
+    /* Pause the ingame timer whenever requested */
+    if (timeControl.areBothTimerValid() && timeControl.isIngameTimerRunning()
+            && newdata.timercontrol == FluffelProtocol::timeControlPause) {
+        qDebug("Pausing ingame timer.");
+        timeControl.pauseIngameTimerAt(event.timestamp);
+        ipcTransitions++;
+    }
+
+    /* Resume ingame timer whenever requested */
+    else if (timeControl.areBothTimerValid() && !timeControl.isIngameTimerRunning()
+             && newdata.timercontrol == FluffelProtocol::timeControlNone) {
+        qDebug("Continuing ingame timer");
+        timeControl.resumeIngameTimerAt(event.timestamp);
+        ipcTransitions++;
+    }
+}
+
+void MainWindow::processIPCCommand(const FluffelIPCThread::listenerEvent& event) {
+    /* Same as for the states: the commands only have an effect if the respective options
+     * (autosplit, etc.) are set by the user. All timer changes are done at the time of the
+     * event. */
+    int remains = -1;
+
+    switch (event.type) {
+        case FluffelProtocol::commandPause:
+            if (timeControl.areBothTimerValid() && timeControl.isIngameTimerRunning()) {
+                qDebug("Pausing ingame timer.");
+                timeControl.pauseIngameTimerAt(event.timestamp);
+                ipcTransitions++;
+            }
+            break;
+
+        case FluffelProtocol::commandResume:
+            if (timeControl.areBothTimerValid() && !timeControl.isIngameTimerRunning()) {
+                qDebug("Continuing ingame timer");
+                timeControl.resumeIngameTimerAt(event.timestamp);
+                ipcTransitions++;
+            }
+            break;
+
+        case FluffelProtocol::commandSplit:
+            if (!autosplit) {
+                break;
+            }
+
+            /* Same as a manual split: start the timers if they are not running */
+            if (!timeControl.areBothTimerValid()) {
+                qDebug("Start");
+                timeControl.startBothTimerAt(event.timestamp);
+                break;
+            }
+
+            qDebug("Split");
+            remains = data.split(timeControl.elapsedPreferredTimeAt(event.timestamp));
+
+            /* Stop the timer if that was the last split */
+            if (remains == 0) {
+                timeControl.pauseBothTimerAt(event.timestamp);
+            }
+            break;
+
+        case FluffelProtocol::commandSplitToSection:
+            if (autosplit && timeControl.areBothTimerValid()) {
+                qDebug("Do an autosplit to section %lld", event.value);
+                remains = data.splitToSection(static_cast<unsigned int>(event.value), timeControl.elapsedPreferredTimeAt(event.timestamp));
+            }
+            break;
+
+        case FluffelProtocol::commandSetIcons:
+            icons.setStates(event.icons);
+            break;
+
+        case FluffelProtocol::commandSetGameTime:
+            if (timeControl.areBothTimerValid()) {
+                qDebug("Setting ingame time to %lld ms", event.value);
+                timeControl.setIngameTimeAt(event.value * FluffelTimer::nsecsPerMSec, event.timestamp);
+            }
+            break;
+
+        case FluffelProtocol::commandStart:
+            if (autostartstop && !timeControl.areBothTimerValid()) {
+                qDebug("Got start command, resetting and starting both timers.");
+                timeControl.resetBothTimer();
+                timeControl.startBothTimerAt(event.timestamp);
+            }
+            break;
+
+        case FluffelProtocol::commandStop:
+            if (autostartstop && timeControl.isAnyTimerRunning()) {
+                qDebug("Got stop command. Stopping both timers and do a split.");
+                timeControl.pauseBothTimerAt(event.timestamp);
+                remains = data.split(timeControl.elapsedPreferredTimeAt(event.timestamp));
+            }
+            break;
+
+        case FluffelProtocol::commandUndo:
+            if (autosplit) {
+                qDebug("Undo split");
+                remains = data.undoSplit();
+            }
+            break;
+
+        case FluffelProtocol::commandSkip:
+            if (autosplit && timeControl.areBothTimerValid()) {
+                qDebug("Skip segment");
+                remains = data.skip();
+            }
+            break;
+
+        case FluffelProtocol::commandPing:
+            /* Everything sent before the ping is applied now */
+            ipcthread.sendPong(event.client, static_cast<quint32>(event.value), ipcTransitions);
+            break;
+    }
+
+    /* Update the segments shown if the split data changed */
+    if (remains != -1) {
+        int segments = updateDisplaySegments();
+        qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
+    }
+}
+
+void MainWindow::publishState() {
+    if (!publishing) {
+        return;
+    }
+
+    /* This is called through onStateChanged after every change that may affect the
+     * state (IPC events, the user's actions, loading or restoring a run), often with
+     * nothing new, so only compare here and build messages only for what changed.
+     * Writing is done by the publisher thread. */
+    int realTimer = timerReset;
+    int ingameTimer = timerReset;
+
+    if (timeControl.areBothTimerValid()) {
+        realTimer = timeControl.isAnyTimerRunning() ? timerRunning : timerPaused;
+        ingameTimer = timeControl.isIngameTimerRunning() ? timerRunning : timerPaused;
+    }
+
+    if (!published.valid || (realTimer != published.realTimer) || (ingameTimer != published.ingameTimer)) {
+        static const char *names[] = { "reset", "paused", "running" };
+
+        QJsonObject message;
+        message["real"] = names[realTimer];
+        message["ingame"] = names[ingameTimer];
+        message["realTime"] = static_cast<qint64>(timeControl.elapsedRealTime() / FluffelTimer::nsecsPerMSec);
+        message["ingameTime"] = static_cast<qint64>(timeControl.elapsedIngameTime() / FluffelTimer::nsecsPerMSec);
+        publishMessage("timer", message);
 
-            displaySegments.clear();
-            int remains = data.splitToSection(tempData.section, timeControl.elapsedPreferredTime());
-            int segments = data.getCurrentSegments(displaySegments, segmentLines);
-            qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
+        published.realTimer = realTimer;
+        published.ingameTimer = ingameTimer;
+    }
+
+    unsigned int section = data.getCurrentSection();
+    if (!published.valid || (section != published.section)) {
+        QJsonObject message;
+        message["section"] = static_cast<qint64>(section);
+        publishMessage("section", message);
+
+        published.section = section;
+    }
+
+    int splits = data.getSplitCount();
+    if (!published.valid || (splits != published.splits)) {
+        QJsonObject message;
+        message["splits"] = splits;
+
+        SplitData::segment last;
+        if (data.getLastSplit(last)) {
+            QJsonObject segment;
+            segment["title"] = data.getSegmentTitle(last.index);
+            segment["time"] = last.runtime / FluffelTimer::nsecsPerMSec;
+            segment["totalTime"] = last.totaltime / FluffelTimer::nsecsPerMSec;
+            segment["difference"] = last.totalimprotime / FluffelTimer::nsecsPerMSec;
+            segment["skipped"] = last.skipped;
+            message["segment"] = segment;
         }
 
-        /* Pause the ingame timer whenever requested */
-        if (timeControl.areBothTimerValid() && timeControl.isIngameTimerRunning()
-                && tempData.timercontrol == FluffelIPCThread::timeControlPause) {
-            qDebug("Pausing ingame timer.");
-            timeControl.pauseIngameTimer();
+        /* Tell overlays why the number changed */
+        if (!published.valid || (splits > published.splits)) {
+            publishMessage("split", message);
+        } else if ((splits == 0) && (realTimer == timerReset)) {
+            publishMessage("reset", message);
+        } else {
+            publishMessage("undo", message);
         }
 
-        /* Resume ingame timer whenever requested */
-        else if (timeControl.areBothTimerValid() && !timeControl.isIngameTimerRunning()
-                 && tempData.timercontrol == FluffelIPCThread::timeControlNone) {
-            qDebug("Continuing ingame timer");
-            timeControl.resumeIngameTimer();
+        published.splits = splits;
+    }
+
+    const QBitArray &iconStates = icons.getStates();
+    if (!published.valid || (iconStates != published.icons)) {
+        QString states;
+        for (int i = 0; i < iconStates.size(); ++i) {
+            states.append(iconStates.testBit(i) ? '1' : '0');
         }
+
+        QJsonObject message;
+        message["icons"] = static_cast<qint64>(icons.getFirstStates());
+        message["states"] = states;
+        publishMessage("icons", message);
+
+        published.icons = iconStates;
     }
 
-    /* Update the display */
-    update();
+    published.valid = true;
+}
+
+void MainWindow::publishMessage(const QString& event, QJsonObject& message) {
+    message["event"] = event;
+    message["timestamp"] = FluffelTimer::monotonicNSecs();
+
+    /* Split, undo and reset all describe the splits, so new subscribers only need the latest */
+    QString topic = (event == "undo" || event == "reset") ? QString("split") : event;
+    publisher.publish(topic, QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
 }
 
 void MainWindow::onSplit() {
@@ -144,20 +541,22 @@ void MainWindow::onSplit() {
         qDebug("Start");
 
         timeControl.startBothTimer();
+        onStateChanged();
         return;
     }
 
     /* Otherwise, split the time here */
     qDebug("Split");
-    displaySegments.clear();
     int remains = data.split(timeControl.elapsedPreferredTime());
-    int segments = data.getCurrentSegments(displaySegments, segmentLines);
+    int segments = updateDisplaySegments();
     qDebug("Got %d segments from data object. %d remaining segments.", segments, remains);
 
     /* Stop the timer if that was the last split */
     if (remains == 0) {
         timeControl.pauseBothTimer();
     }
+
+    onStateChanged();
 }
 
 void MainWindow::onPause() {
@@ -170,6 +569,7 @@ void MainWindow::onPause() {
     /* Check if paused or not */
     qDebug("Toggle timer");
     timeControl.toggleBothTimer();
+    onStateChanged();
 }
 
 void MainWindow::onReset() {
@@ -177,6 +577,7 @@ void MainWindow::onReset() {
 
     /* Pause timer so they do not continue running */
     timeControl.pauseBothTimer();
+    onStateChanged();
 
     /* Check if there have been splits and ask user about data */
     if (data.hasSplit()) {
@@ -188,12 +589,13 @@ void MainWindow::onReset() {
 
     qDebug("Reset");
     timeControl.resetBothTimer();
-    displaySegments.clear();
 
     /* Reset data */
     data.reset(merge);
-    int segments = data.getCurrentSegments(displaySegments, segmentLines);
+    int segments = updateDisplaySegments();
     qDebug("Got %d segments from data object", segments);
+
+    onStateChanged();
 }
 
 void MainWindow::onOpen() {
@@ -201,6 +603,7 @@ void MainWindow::onOpen() {
 
     /* Pause timer so they do not continue running */
     timeControl.pauseBothTimer();
+    onStateChanged();
 
     /* Check if there have been splits and ask user about data */
     if (data.hasSplit()) {
@@ -220,16 +623,30 @@ void MainWindow::onOpen() {
     if (filename.length() == 0)
         return;
 
+    openSplitData(filename);
+}
+
+void MainWindow::openSplitData(const QString& filename) {
     /* Load data */
     data.loadData(filename);
 
     /* Set back timers, display, etc. */
     timeControl.resetBothTimer();
 
-    displaySegments.clear();
-    data.getCurrentSegments(displaySegments, segmentLines);
+    updateDisplaySegments();
 
     calculateRegionSizes();
+    onStateChanged();
+}
+
+void MainWindow::setClock(FluffelClock* clock) {
+    Q_ASSERT(headless || (clock == FluffelClock::monotonic()));
+    timeControl.setClock(clock);
+    onStateChanged();
+}
+
+bool MainWindow::isRunning() {
+    return timeControl.areBothTimerValid() && timeControl.isAnyTimerRunning();
 }
 
 void MainWindow::onSave() {
@@ -240,6 +657,8 @@ void MainWindow::onSave() {
 
     /* Merging unsaved data */
     data.reset(true);
+    invalidateStaticLayer();
+    onStateChanged();
 
     /* Check for filename */
     if (data.getFilename().size() == 0) {
@@ -254,6 +673,7 @@ void MainWindow::onSaveAs() {
 
     /* Pause timer so they do not continue running */
     timeControl.pauseBothTimer();
+    onStateChanged();
 
     /* Let the user select a filename to save the segment data */
     QString filename = QFileDialog::getSaveFileName(this, "Save segment data", data.getFilename(), "All files (*.*)");
@@ -294,6 +714,11 @@ void MainWindow::onToggleAutostartstop(bool enable) {
     autostartstop = enable;
 }
 
+void MainWindow::onToggleFrameStats(bool enable) {
+    showFrameStats = enable;
+    update();
+}
+
 void MainWindow::onExit() {
     /* Whatever is in the split data, save it as a temporary file with a time stamp
      * and set it as last filename used. Of course, only if the split data changed
@@ -308,6 +733,7 @@ void MainWindow::onExit() {
 
     /* Destroy the settings here to sync it and write everything to the file. */
     delete settings;
+    settings = nullptr;
 
     /* Close the window */
     this->close();
@@ -319,6 +745,11 @@ void MainWindow::setupContextMenu() {
     separator1->setSeparator(true);
     separator2->setSeparator(true);
 
+    /* Debug overlay with the frame timing */
+    QAction *actionFrameStats = new QAction("Show frame statistics", this);
+    actionFrameStats->setCheckable(true);
+    connect(actionFrameStats, &QAction::toggled, this, &MainWindow::onToggleFrameStats);
+
     this->addAction(ui->action_Start_Split);
     this->addAction(ui->action_Pause);
     this->addAction(ui->action_Reset);
@@ -330,6 +761,7 @@ void MainWindow::setupContextMenu() {
     this->addAction(ui->actionSave_as);
     this->addAction(ui->actionAutosave_at_exit);
     this->addAction(separator2);
+    this->addAction(actionFrameStats);
     this->addAction(ui->action_Exit);
 }
 
@@ -350,13 +782,12 @@ void MainWindow::setupGlobalShortcuts() {
 }
 
 void MainWindow::readSettings() {
-    /* Read font and color settings into maps for convenient access */
-    readSettingsFonts();
-    readSettingsColors();
-    backgroundBrush = QBrush(userColors["background"]);
+    /* Read font and color settings */
+    readSettingsTheme();
 
     /* General settings */
     marginSize = settings->value("marginSize", 0).toInt();
+    refreshRate = settings->value("refreshRate", 0).toInt();
     segmentLines = qMax(2, settings->value("segmentLines").toInt());
 
     /* Autosplit, Autosave, Autostart/stop (will automatically set the boolean through the toggle slot) */
@@ -366,42 +797,50 @@ void MainWindow::readSettings() {
 
     /* Read the segment and food data if available */
     readSettingsData();
+
+    /* How the states of several autosplitters are merged */
+    if (!headless) {
+        readSettingsIPC();
+    }
 }
 
-void MainWindow::readSettingsFonts() {
-    /* Get all keys from the fonts group */
-    settings->beginGroup("Fonts");
-    QStringList keys = settings->allKeys();
+void MainWindow::readSettingsTheme() {
+    /* Fonts and colors are prepared once for painting */
+    theme.load(*settings);
 
-    /* Iterate over each key and create an entry in the map. The value is read into a string
-     * and then converted to a QFont by fromString. */
-    for(int i = 0; i < keys.size(); ++i) {
-        QFont value;
+    /* The glyphs need to be rendered again */
+    glyphAtlases.clear();
+    glyphAtlases.resize(FluffelTheme::fontCount * FluffelTheme::colorCount);
+}
 
-        if (value.fromString(settings->value(keys[i], QFont("Arial", 18, QFont::Bold).toString()).toString())) {
-            userFonts.insert(keys[i], value);
-        }
-    }
+void MainWindow::setupSettingsWatcher() {
+    /* Editors write files in several steps, so wait a moment before reloading */
+    settingsReloadTimer.setSingleShot(true);
+    settingsReloadTimer.setInterval(100);
 
-    /* Reset the group */
-    settings->endGroup();
-}
+    connect(&settingsWatcher, &QFileSystemWatcher::fileChanged, this, [this]() { settingsReloadTimer.start(); });
+    connect(&settingsReloadTimer, &QTimer::timeout, this, &MainWindow::reloadTheme);
 
-void MainWindow::readSettingsColors() {
-    /* Read the keys and settings from the colors group */
-    settings->beginGroup("Colors");
-    QStringList keys = settings->allKeys();
+    settingsWatcher.addPath(settings->fileName());
+}
 
-    /* Iterate over each key and create an entry in the map. The value is read into a string
-     * and then converted to QColor. */
-    for(int i = 0; i < keys.size(); ++i) {
-        QColor value = QColor(settings->value(keys[i], "#fefefe").toString());
+void MainWindow::reloadTheme() {
+    if (settings == nullptr) {
+        return;
+    }
 
-        userColors.insert(keys[i], value);
+    /* Editors often replace the file, which removes it from the watcher */
+    if (!settingsWatcher.files().contains(settings->fileName()) && QFile::exists(settings->fileName())) {
+        settingsWatcher.addPath(settings->fileName());
     }
 
-    /* Reset the group */
-    settings->endGroup();
+    settings->sync();
+    readSettingsTheme();
+    qDebug("Theme reloaded from %s", settings->fileName().toStdString().c_str());
+
+    /* Lay out everything once with the new fonts and rebuild the caches */
+    updateDisplaySegments();
+    calculateRegionSizes();
 }
 
 void MainWindow::readSettingsData() {
@@ -410,10 +849,11 @@ void MainWindow::readSettingsData() {
 
     QString segmentData = settings->value("segmentData").toString();
     QString foodData = settings->value("foodData").toString();
+    journalFilename = settings->value("journal", "fluffelwatch.journal").toString();
 
     /* Load segment data */
     data.loadData(segmentData);
-    int segments = data.getCurrentSegments(displaySegments, segmentLines);
+    int segments = updateDisplaySegments();
     qDebug("Segment data loaded from... %s", segmentData.toStdString().c_str());
     qDebug("Got %d segments from data object", segments);
 
@@ -422,72 +862,336 @@ void MainWindow::readSettingsData() {
     icons.showAllIcons();
     qDebug("Food data loaded from... %s", foodData.toStdString().c_str());
 
+    invalidateStaticLayer();
+
+    settings->endGroup();
+}
+
+void MainWindow::setupJournal() {
+    if (journalFilename.isEmpty()) {
+        return;
+    }
+
+    /* A journal with a run in it means that Fluffelwatch was not closed properly */
+    QVector<FluffelJournal::entry> entries;
+    bool restore = false;
+
+    if (FluffelJournal::read(journalFilename, entries) && FluffelJournal::hasRun(entries)) {
+        int ret = QMessageBox::question(this, "Restore run", "Fluffelwatch was not closed properly during the last run. "
+                                        "Do you want to restore this run?", QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+
+        restore = (ret == QMessageBox::Yes);
+    }
+
+    if (restore) {
+        int applied = FluffelJournal::replay(entries, timeControl, data);
+        qDebug("Restored the last run from %d journal records.", applied);
+
+        /* The journal may have loaded another split file, like openSplitData */
+        updateDisplaySegments();
+
+        calculateRegionSizes();
+        onStateChanged();
+    }
+
+    /* Keep the records of a restored run, so it can be restored again */
+    if (!journal.open(journalFilename, restore)) {
+        return;
+    }
+
+    /* A new journal starts with the split data already loaded */
+    if (!restore && !data.getFilename().isEmpty()) {
+        journal.record(FluffelJournal::recordLoad, FluffelTimer::monotonicNSecs(), data.getFilename().toUtf8());
+    }
+
+    timeControl.setJournal(&journal);
+    data.setJournal(&journal);
+}
+
+void MainWindow::readSettingsIPC() {
+    settings->beginGroup("IPC");
+
+    FluffelStateMerger::rules rules = FluffelStateMerger::rulesFromStrings(settings->value("mergeIcons", "or").toString(),
+                                                                           settings->value("mergeSection", "max").toString(),
+                                                                           settings->value("controlPriority").toStringList());
+    ipcthread.setMergeRules(rules);
+
+    /* Capturing everything the clients send, e.g. for reproducing autosplitter problems */
+    ipcthread.setCaptureFile(settings->value("capture").toString());
+
+    /* Publishing the state for overlays */
+    publishing = settings->value("publishState", true).toBool();
+
+    /* Optional transport through shared memory */
+    if (settings->value("sharedMemory", false).toBool()) {
+        sharedState.open();
+    } else {
+        sharedState.close();
+    }
+
     settings->endGroup();
 }
 
-void MainWindow::paintAllElements(QPainter& painter) {
+void MainWindow::paintStaticElements(QPainter& painter, int currentLine) {
     /* Main title (taken from split data file) */
-    paintText(painter, regionTitle, userFonts["mainTitle"], userColors["mainTitle"], data.getTitle(), Qt::AlignCenter);
+    paintText(painter, regionTitle, FluffelTheme::fontMainTitle, FluffelTheme::colorMainTitle, data.getTitle(), Qt::AlignCenter);
 
     /* Separators */
     paintSeparator(painter, regionTitle.bottomLeft(), regionTitle.bottomRight());
     paintSeparator(painter, regionTimeList.bottomLeft(), regionTimeList.bottomRight());
 
-    /* Paint all segments (middle part) */
+    /* Paint all segments (middle part) except the current one */
     int lines = qMin(segmentLines, displaySegments.size());
     for (int i = 0; i < lines; ++i) {
-        paintSegmentLine(painter, QRect(marginSize,
-                                        regionTimeList.top() + marginSize + i * segmentSize.height(),
-                                        segmentSize.width(),
-                                        segmentSize.height()), displaySegments[i]);
-    }
-
-    /* Status area: the icons + the ingame and real timer */
-    QRect rectReal = QRect(regionStatus.right() - mainTimerSize.width() - marginSize,
-                           regionStatus.top() + marginSize,
-                           mainTimerSize.width(),
-                           mainTimerSize.height());
-    QRect rectIngame = QRect(regionStatus.right() - adjustedTimerSize.width() - marginSize,
-                             regionStatus.bottom() - adjustedTimerSize.height() - marginSize,
-                             adjustedTimerSize.width(),
-                             adjustedTimerSize.height());
+        if (i != currentLine) {
+            paintSegmentLine(painter, getSegmentLineRect(i), displaySegments[i], displayStrings[i]);
+        }
+    }
 
+    /* Status area: the icons (the timers are painted on top) */
     icons.paint(painter, regionStatus);
-    paintText(painter, rectReal, userFonts["realTimer"], userColors["realTimer"],
-              timeControl.elapsedRealTimeString(), Qt::AlignRight | Qt::AlignVCenter);
-    paintText(painter, rectIngame, userFonts["ingameTimer"], userColors["ingameTimer"],
-              timeControl.elapsedIngameTimeString(), Qt::AlignRight | Qt::AlignVCenter);
 }
 
-void MainWindow::paintText(QPainter& painter, const QRect& rect, const QFont& font, const QColor& color, const QString& text, int flags) {
-    painter.setFont(font);
-    painter.setPen(color);
+void MainWindow::paintDynamicElements(QPainter& painter, const QRect& dirty) {
+    /* The current segment shows the running time */
+    int currentLine = getCurrentSegmentLine();
+    if (currentLine > -1) {
+        QRect rect = getSegmentLineRect(currentLine);
+        if (rect.intersects(dirty)) {
+            paintSegmentLineCurrent(painter, rect, displaySegments[currentLine], displayStrings[currentLine]);
+        }
+    }
+
+    /* The ingame and real timer */
+    if (rectRealTimer.intersects(dirty)) {
+        paintTime(painter, rectRealTimer, FluffelTheme::fontRealTimer, FluffelTheme::colorRealTimer,
+                  formatLiveTime(liveRealTimer, timeControl.elapsedRealTime()), Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    if (rectIngameTimer.intersects(dirty)) {
+        paintTime(painter, rectIngameTimer, FluffelTheme::fontIngameTimer, FluffelTheme::colorIngameTimer,
+                  formatLiveTime(liveIngameTimer, timeControl.elapsedIngameTime()), Qt::AlignRight | Qt::AlignVCenter);
+    }
+}
+
+int MainWindow::updateDisplaySegments() {
+    int segments = data.getCurrentSegments(displaySegments, segmentLines);
+
+    /* Past and future segments do not change until the next split */
+    displayStrings.resize(displaySegments.size());
+    for (int i = 0; i < displaySegments.size(); ++i) {
+        displayStrings[i].title.setTextFormat(Qt::PlainText);
+        displayStrings[i].title.setText(data.getSegmentTitle(displaySegments[i].index));
+        displayStrings[i].title.prepare(QTransform(), theme.getFont(FluffelTheme::fontSegmentTitle));
+
+        FluffelTimer::formatTime(displaySegments[i].totaltime, displayStrings[i].time);
+        FluffelTimer::formatTimeDiff(displaySegments[i].totalimprotime, displayStrings[i].diff);
+    }
+
+    invalidateStaticLayer();
+    return segments;
+}
+
+const QString& MainWindow::formatLiveTime(MainWindow::liveString& live, qint64 time, bool diff) {
+    /* The sign matters for differences: −00.01 and +00.01 have the same centiseconds */
+    qint64 centis = time / 10000000;
+    bool negative = (time < 0);
+
+    if (live.text.isEmpty() || (centis != live.centis) || (negative != live.negative)) {
+        if (diff) {
+            FluffelTimer::formatTimeDiff(time, live.text);
+        } else {
+            FluffelTimer::formatTime(time, live.text);
+        }
+
+        live.centis = centis;
+        live.negative = negative;
+    }
+
+    return live.text;
+}
+
+void MainWindow::invalidateStaticLayer() {
+    staticLayerValid = false;
+    update();
+}
+
+void MainWindow::updateStaticLayer() {
+    int currentLine = getCurrentSegmentLine();
+    const QBitArray &iconStates = icons.getStates();
+    qreal ratio = devicePixelRatioF();
+
+    if (staticLayerValid && (staticLayerLine == currentLine) && (staticLayer.size() == size() * ratio)) {
+        if (staticLayerIcons != iconStates) {
+            updateStaticLayerIcons();
+        }
+        return;
+    }
+
+    /* Paint in the resolution of the screen, so the copy is 1:1 */
+    staticLayer = QPixmap(size() * ratio);
+    staticLayer.setDevicePixelRatio(ratio);
+    staticLayer.fill(palette().color(QPalette::Window));
+
+    QPainter painter(&staticLayer);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    painter.setBrush(theme.getBackground());
+    painter.drawRect(this->rect());
+
+    paintStaticElements(painter, currentLine);
+
+    staticLayerValid = true;
+    staticLayerLine = currentLine;
+    staticLayerIcons = iconStates;
+}
+
+void MainWindow::updateStaticLayerIcons() {
+    /* Only the cells of the changed icons: background, the separator above the
+     * status area (which touches the icons) and the icons themselves */
+    QRegion cells = icons.getChangedRegion(regionStatus, staticLayerIcons);
+
+    QPainter painter(&staticLayer);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setClipRegion(cells);
+
+    painter.fillRect(cells.boundingRect(), palette().color(QPalette::Window));
+    painter.setBrush(theme.getBackground());
+    painter.drawRect(this->rect());
+
+    paintSeparator(painter, regionTimeList.bottomLeft(), regionTimeList.bottomRight());
+    icons.paintChanged(painter, regionStatus, staticLayerIcons);
+
+    staticLayerIcons = icons.getStates();
+}
+
+void MainWindow::updateDynamicRegions() {
+    /* The static layer is painted again in paintEvent if the current line
+     * changed; this needs the whole window. */
+    if (!staticLayerValid || (staticLayerLine != getCurrentSegmentLine())) {
+        update();
+        return;
+    }
+
+    /* Otherwise only repaint the icons that changed and the times that show
+     * another centisecond */
+    qint64 realCentis = timeControl.elapsedRealTime() / 10000000;
+    qint64 ingameCentis = timeControl.elapsedIngameTime() / 10000000;
+    qint64 segmentCentis = timeControl.elapsedPreferredTime() / 10000000;
+    bool changed = false;
+
+    if (staticLayerIcons != icons.getStates()) {
+        update(icons.getChangedRegion(regionStatus, staticLayerIcons));
+        changed = true;
+    }
+
+    if ((staticLayerLine > -1) && (segmentCentis != shownSegmentCentis)) {
+        update(getSegmentLineRect(staticLayerLine));
+        changed = true;
+    }
+
+    if (realCentis != shownRealCentis) {
+        update(rectRealTimer);
+        changed = true;
+    }
+
+    if (ingameCentis != shownIngameCentis) {
+        update(rectIngameTimer);
+        changed = true;
+    }
+
+    if (showFrameStats) {
+        update(regionFrameStats);
+        changed = true;
+    }
+
+    shownRealCentis = realCentis;
+    shownIngameCentis = ingameCentis;
+    shownSegmentCentis = segmentCentis;
+
+    /* Measure from the first request until the paint */
+    if (changed && (repaintRequested == 0)) {
+        repaintRequested = FluffelTimer::monotonicNSecs();
+    }
+}
+
+QRect MainWindow::getSegmentLineRect(int line) const {
+    return QRect(marginSize,
+                 regionTimeList.top() + marginSize + line * segmentSize.height(),
+                 segmentSize.width(),
+                 segmentSize.height());
+}
+
+int MainWindow::getCurrentSegmentLine() {
+    /* The current segment is only shown with its running time if the timers are on */
+    if (!timeControl.areBothTimerValid()) {
+        return -1;
+    }
+
+    int lines = qMin(segmentLines, displaySegments.size());
+    for (int i = 0; i < lines; ++i) {
+        if (!displaySegments[i].ran && displaySegments[i].current) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void MainWindow::paintText(QPainter& painter, const QRect& rect, FluffelTheme::font font, FluffelTheme::color color, const QString& text, int flags) {
+    painter.setFont(theme.getFont(font));
+    painter.setPen(theme.getPen(color));
     painter.drawText(rect, flags, text);
 }
 
+void MainWindow::paintTime(QPainter& painter, const QRect& rect, FluffelTheme::font font, FluffelTheme::color color, const QString& text, int flags) {
+    /* Times are copied glyph by glyph from the atlas of their font and color */
+    if (!getGlyphAtlas(font, color).draw(painter, rect, text, flags)) {
+        paintText(painter, rect, font, color, text, flags);
+    }
+}
+
+void MainWindow::paintTitle(QPainter& painter, const QRect& rect, FluffelTheme::font font, FluffelTheme::color color, const QStaticText& text) {
+    /* The text is already laid out; just center it vertically */
+    painter.setFont(theme.getFont(font));
+    painter.setPen(theme.getPen(color));
+    painter.drawStaticText(QPointF(rect.left(), rect.top() + (rect.height() - text.size().height()) / 2), text);
+}
+
+const FluffelGlyphAtlas& MainWindow::getGlyphAtlas(FluffelTheme::font font, FluffelTheme::color color) {
+    /* The atlas is rendered when it is used the first time (or the screen changed) */
+    FluffelGlyphAtlas &atlas = glyphAtlases[font * FluffelTheme::colorCount + color];
+    qreal ratio = devicePixelRatioF();
+
+    if (!atlas.matches(theme.getFont(font), theme.getColor(color), ratio)) {
+        atlas.build(theme.getFont(font), theme.getColor(color), ratio);
+    }
+
+    return atlas;
+}
+
 void MainWindow::paintSeparator(QPainter& painter, const QPoint& start, const QPoint& end) {
-    painter.setPen(userColors["separatorLine"]);
+    painter.setPen(theme.getPen(FluffelTheme::colorSeparatorLine));
     painter.drawLine(start, end);
 }
 
-void MainWindow::paintSegmentLine(QPainter& painter, const QRect& rect, SplitData::segment& segment) {
+void MainWindow::paintSegmentLine(QPainter& painter, const QRect& rect, const SplitData::segment& segment, const segmentStrings& strings) {
     /* Decide which state we want to draw: past segments, current segment (when timer are on), and
      * future segments. */
     if (segment.ran) {
-        paintSegmentLinePast(painter, rect, segment);
+        paintSegmentLinePast(painter, rect, segment, strings);
     } else if (segment.current && timeControl.areBothTimerValid()) {
-        paintSegmentLineCurrent(painter, rect, segment);
+        paintSegmentLineCurrent(painter, rect, segment, strings);
     } else {
-        paintSegmentLineFuture(painter, rect, segment);
+        paintSegmentLineFuture(painter, rect, segment, strings);
     }
 }
 
-void MainWindow::paintSegmentLinePast(QPainter& painter, const QRect& rect, SplitData::segment& segment) {
+void MainWindow::paintSegmentLinePast(QPainter& painter, const QRect& rect, const SplitData::segment& segment, const segmentStrings& strings) {
     /* Draw a past/ran segment */
 
     /* Segment title */
-    paintText(painter, rect, userFonts["segmentTitle"], userColors["segmentTitle"],
-              segment.title, Qt::AlignLeft | Qt::AlignVCenter);
+    paintTitle(painter, rect, FluffelTheme::fontSegmentTitle, FluffelTheme::colorSegmentTitle, strings.title);
 
     /* Segment difference time; display only if the segment was ran or it is the current segment */
     QRect rectDiff = QRect(rect.right() - segmentColumnSizes[2] - segmentColumnSizes[1] - marginSize * 2,
@@ -495,15 +1199,15 @@ void MainWindow::paintSegmentLinePast(QPainter& painter, const QRect& rect, Spli
                            segmentColumnSizes[1],
                            rect.height());
 
-    QColor textColor = userColors["segmentTitle"];
+    FluffelTheme::color textColor = FluffelTheme::colorSegmentTitle;
     if (segment.improtime < 0) {
-        textColor = userColors["gainedTime"];
+        textColor = FluffelTheme::colorGainedTime;
     } else if (segment.improtime > 0 ) {
-        textColor = userColors["lostTime"];
+        textColor = FluffelTheme::colorLostTime;
     }
 
-    paintText(painter, rectDiff, userFonts["segmentDiff"], textColor,
-              TimeController::getStringFromTimeDiff(segment.totalimprotime), Qt::AlignRight | Qt::AlignVCenter);
+    paintTime(painter, rectDiff, FluffelTheme::fontSegmentDiff, textColor,
+              strings.diff, Qt::AlignRight | Qt::AlignVCenter);
 
 
     /* Segment time (lost or improvement) */
@@ -512,26 +1216,25 @@ void MainWindow::paintSegmentLinePast(QPainter& painter, const QRect& rect, Spli
                            segmentColumnSizes[2],
                            rect.height());
 
-    textColor = userColors["segmentTime"];
+    textColor = FluffelTheme::colorSegmentTime;
     if (segment.runtime < segment.besttime) {
-        textColor = userColors["newRecord"];
+        textColor = FluffelTheme::colorNewRecord;
     } else if (segment.improtime > 0) {
-        textColor = userColors["lostTime"];
+        textColor = FluffelTheme::colorLostTime;
     } else if (segment.improtime < 0) {
-        textColor = userColors["gainedTime"];
+        textColor = FluffelTheme::colorGainedTime;
     }
 
-    paintText(painter, rectTime, userFonts["segmentTime"], textColor,
-              TimeController::getStringFromTime(segment.totaltime), Qt::AlignRight | Qt::AlignVCenter);
+    paintTime(painter, rectTime, FluffelTheme::fontSegmentTime, textColor,
+              strings.time, Qt::AlignRight | Qt::AlignVCenter);
 
 }
 
-void MainWindow::paintSegmentLineCurrent(QPainter& painter, const QRect& rect, SplitData::segment& segment) {
+void MainWindow::paintSegmentLineCurrent(QPainter& painter, const QRect& rect, const SplitData::segment& segment, const segmentStrings& strings) {
     /* Draw the current segment with the timers on */
 
     /* Highlighted segment title */
-    paintText(painter, rect, userFonts["segmentTitle"], userColors["currentSegment"],
-              segment.title, Qt::AlignLeft | Qt::AlignVCenter);
+    paintTitle(painter, rect, FluffelTheme::fontSegmentTitle, FluffelTheme::colorCurrentSegment, strings.title);
 
     /* Segment difference time; display only if the segment was ran or it is the current segment */
     QRect rectDiff = QRect(rect.right() - segmentColumnSizes[2] - segmentColumnSizes[1] - marginSize * 2,
@@ -539,11 +1242,12 @@ void MainWindow::paintSegmentLineCurrent(QPainter& painter, const QRect& rect, S
                            segmentColumnSizes[1],
                            rect.height());
 
-    qint64 improtime = timeControl.elapsedPreferredTime() - segment.totaltime;
+    qint64 elapsed = timeControl.elapsedPreferredTime();
+    qint64 improtime = elapsed - segment.totaltime;
 
     /* Display with normal text color */
-    paintText(painter, rectDiff, userFonts["segmentDiff"], userColors["segmentTitle"],
-              TimeController::getStringFromTimeDiff(improtime), Qt::AlignRight | Qt::AlignVCenter);
+    paintTime(painter, rectDiff, FluffelTheme::fontSegmentDiff, FluffelTheme::colorSegmentTitle,
+              formatLiveTime(liveSegmentDiff, improtime, true), Qt::AlignRight | Qt::AlignVCenter);
 
 
     /* Segment time (or improvement) */
@@ -552,42 +1256,41 @@ void MainWindow::paintSegmentLineCurrent(QPainter& painter, const QRect& rect, S
                            segmentColumnSizes[2],
                            rect.height());
 
-    QColor textcolor = userColors["currentSegment"];
+    FluffelTheme::color textcolor = FluffelTheme::colorCurrentSegment;
     if (improtime > 0) {
-        textcolor = userColors["lostTime"];
+        textcolor = FluffelTheme::colorLostTime;
     }
 
-    paintText(painter, rectTime, userFonts["segmentTime"], textcolor,
-              TimeController::getStringFromTime(timeControl.elapsedPreferredTime()), Qt::AlignRight | Qt::AlignVCenter);
+    paintTime(painter, rectTime, FluffelTheme::fontSegmentTime, textcolor,
+              formatLiveTime(liveSegmentTime, elapsed), Qt::AlignRight | Qt::AlignVCenter);
 
 }
 
-void MainWindow::paintSegmentLineFuture(QPainter& painter, const QRect& rect, SplitData::segment& segment) {
+void MainWindow::paintSegmentLineFuture(QPainter& painter, const QRect& rect, const SplitData::segment& segment, const segmentStrings& strings) {
     /* Draw a future segment */
 
     /* Segment title */
-    paintText(painter, rect, userFonts["segmentTitle"], userColors["segmentTitle"],
-              segment.title, Qt::AlignLeft | Qt::AlignVCenter);
+    paintTitle(painter, rect, FluffelTheme::fontSegmentTitle, FluffelTheme::colorSegmentTitle, strings.title);
 
     /* Segment time */
     QRect rectTime = QRect(rect.right() - segmentColumnSizes[2] - marginSize * 2,
                            rect.top(),
                            segmentColumnSizes[2],
                            rect.height());
-    paintText(painter, rectTime, userFonts["segmentTime"], userColors["segmentTime"],
-              TimeController::getStringFromTime(segment.totaltime), Qt::AlignRight | Qt::AlignVCenter);
+    paintTime(painter, rectTime, FluffelTheme::fontSegmentTime, FluffelTheme::colorSegmentTime,
+              strings.time, Qt::AlignRight | Qt::AlignVCenter);
 }
 
 void MainWindow::calculateRegionSizes() {
     /* Calculate title region */
-    QFontMetrics fm(userFonts["mainTitle"]);
+    const QFontMetrics &fm = theme.getFontMetrics(FluffelTheme::fontMainTitle);
     regionTitle = QRect(QPoint(0, 0), fm.size(Qt::TextSingleLine, data.getTitle()));
     regionTitle.adjust(0, 0, marginSize * 2, marginSize * 2);
 
     /* Calculate time list region */
-    QFontMetrics segTitle(userFonts["segmentTitle"]);
-    QFontMetrics segDiff(userFonts["segmentDiff"]);
-    QFontMetrics segTime(userFonts["segmentTime"]);
+    const QFontMetrics &segTitle = theme.getFontMetrics(FluffelTheme::fontSegmentTitle);
+    const QFontMetrics &segDiff = theme.getFontMetrics(FluffelTheme::fontSegmentDiff);
+    const QFontMetrics &segTime = theme.getFontMetrics(FluffelTheme::fontSegmentTime);
     QSize sizeTitle = segTitle.size(Qt::TextSingleLine, data.getLongestSegmentTitle());
     segmentColumnSizes[0] = sizeTitle.width();
     QSize sizeDiff = segDiff.size(Qt::TextSingleLine, " −00:00:00.00 ");
@@ -601,10 +1304,10 @@ void MainWindow::calculateRegionSizes() {
     regionTimeList.adjust(0, 0, marginSize * 2, marginSize * 2);
 
     /* Calculate status bar (with the two timers) */
-    QFontMetrics mtFm(userFonts["realTimer"]);
+    const QFontMetrics &mtFm = theme.getFontMetrics(FluffelTheme::fontRealTimer);
     mainTimerSize = mtFm.size(Qt::TextSingleLine, "00:00:00.00");
 
-    QFontMetrics atFm(userFonts["ingameTimer"]);
+    const QFontMetrics &atFm = theme.getFontMetrics(FluffelTheme::fontIngameTimer);
     adjustedTimerSize = atFm.size(Qt::TextSingleLine, "00:00:00.00");
 
     QSize iconArea = adjustedTimerSize;
@@ -622,11 +1325,30 @@ void MainWindow::calculateRegionSizes() {
     windowSize.setHeight(regionTitle.height() + regionTimeList.height() + regionStatus.height());
     resize(windowSize);
 
+    /* Frame statistics are shown in the top left corner */
+    frameStatsFont = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    QFontMetrics fsFm(frameStatsFont);
+    QStringList frameStatsLines = frameStats.summary();
+    regionFrameStats = QRect(QPoint(0, 0), fsFm.size(Qt::TextSingleLine, frameStatsLines.first()));
+    regionFrameStats.setHeight(regionFrameStats.height() * frameStatsLines.size());
+
     /* Update all regions to have the max width */
     regionTitle.setWidth(maxWidth);
     regionTimeList.setWidth(maxWidth);
     segmentSize.setWidth(maxWidth);
     regionStatus.setWidth(maxWidth);
+
+    /* Status area: the ingame and real timer */
+    rectRealTimer = QRect(regionStatus.right() - mainTimerSize.width() - marginSize,
+                          regionStatus.top() + marginSize,
+                          mainTimerSize.width(),
+                          mainTimerSize.height());
+    rectIngameTimer = QRect(regionStatus.right() - adjustedTimerSize.width() - marginSize,
+                            regionStatus.bottom() - adjustedTimerSize.height() - marginSize,
+                            adjustedTimerSize.width(),
+                            adjustedTimerSize.height());
+
+    invalidateStaticLayer();
 }
 
 
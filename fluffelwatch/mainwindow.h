@@ -3,17 +3,33 @@
 
 #include <QDateTime>
 #include <QFileDialog>
+#include <QFileSystemWatcher>
+#include <QFontDatabase>
 #include <QFontMetrics>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMainWindow>
 #include <QMap>
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QPixmap>
+#include <QScreen>
 #include <QSettings>
+#include <QStaticText>
+#include <QTimer>
+#include <QWindow>
 
 #include "icondisplay.h"
+#include "fluffelframestats.h"
+#include "fluffelglyphatlas.h"
 #include "fluffelipcthread.h"
+#include "fluffeljournal.h"
+#include "fluffelpublisher.h"
+#include "fluffelsharedstate.h"
+#include "fluffeltheme.h"
 #include "splitdata.h"
 #include "timecontroller.h"
 
@@ -27,9 +43,28 @@ class MainWindow : public QMainWindow {
     Q_OBJECT
 
   public:
-    explicit MainWindow(QWidget *parent = 0);
+    /* A headless window reads its settings from configFile, but does not talk to other
+     * programs (no IPC, publishing, journal or global shortcuts); it is meant for
+     * rendering with renderFrame, e.g. under QT_QPA_PLATFORM=offscreen. */
+    explicit MainWindow(QWidget *parent = 0, const QString &configFile = "fluffelwatch.conf", bool headless = false);
     ~MainWindow();
 
+    /* Paints the window into the image as paintEvent would, either completely or only
+     * what a tick repaints (the timers and the current segment). The image needs the
+     * size of the window. */
+    void renderFrame(QImage &image, bool full);
+
+    /* Loads the split data from the file and resets the timers */
+    void openSplitData(const QString &filename);
+
+    /* Clock of the timers, e.g. a virtual one for rendering frames at given times.
+     * Timestamps of IPC events and the journal are always of the monotonic clock,
+     * so other clocks are only allowed headless, where neither is used. */
+    void setClock(FluffelClock *clock);
+
+    /* True while the timers run, i.e. after the start and before the last split */
+    bool isRunning();
+
     /* Mouse events */
     void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
@@ -41,6 +76,11 @@ class MainWindow : public QMainWindow {
     /* Timer event (for painting) */
     void timerEvent(QTimerEvent *event) override;
 
+    /* The refresh timer is stopped while the window is hidden or minimized */
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
   public slots:
     void onSplit();
     void onPause();
@@ -53,9 +93,13 @@ class MainWindow : public QMainWindow {
     void onToggleAutosplit(bool enable);
     void onToggleAutosave(bool enable);
     void onToggleAutostartstop(bool enable);
+    void onToggleFrameStats(bool enable);
 
     void onExit();
 
+    /* Processes all new events from the IPC thread in order */
+    void onIPCEvents();
+
   private:
     /* User interface definitions and setup */
     Ui::MainWindow *ui;    
@@ -64,8 +108,30 @@ class MainWindow : public QMainWindow {
     void setupContextMenu();
     void setupGlobalShortcuts();
 
-    /* Timer id */
-    int timerID;
+    bool headless = false;
+
+    /* The refresh timer only runs while the display can change, i.e. while the timers
+     * run and the window is visible, or while the shared memory needs polling. It runs
+     * with the configured rate or the one of the screen (but at most 100 Hz, since the
+     * times show centiseconds). */
+    int timerID = 0;
+    int timerInterval = 0;
+    int refreshRate = 0;
+    int getRefreshInterval() const;
+    void updateRefreshTimer();
+
+    /* Called after anything changed the timers or splits */
+    void onStateChanged();
+
+    /* Timing of the ticks and paints; shown on top of the window if enabled and
+     * reported when Fluffelwatch is closed */
+    FluffelFrameStats frameStats;
+    bool showFrameStats = false;
+    qint64 lastTick = 0;
+    qint64 repaintRequested = 0;
+    QFont frameStatsFont;
+    QRect regionFrameStats;
+    void paintFrameStats(QPainter &painter);
 
     /* Window movement control */
     bool isMoving = false;
@@ -75,13 +141,16 @@ class MainWindow : public QMainWindow {
      * by a convenient key. */
     QSettings *settings = nullptr;
     void readSettings();
-    void readSettingsFonts();
-    void readSettingsColors();
+    void readSettingsTheme();
     void readSettingsData();
+    void readSettingsIPC();
 
-    QBrush backgroundBrush;
-    QMap<QString, QFont> userFonts;
-    QMap<QString, QColor> userColors;
+    /* Fonts and colors; they are reloaded whenever the settings file changes */
+    FluffelTheme theme;
+    QFileSystemWatcher settingsWatcher;
+    QTimer settingsReloadTimer;
+    void setupSettingsWatcher();
+    void reloadTheme();
 
     bool autosplit = false;
     bool autosave = false;
@@ -93,24 +162,86 @@ class MainWindow : public QMainWindow {
     /* Thread that handles the IPC with external programs, i.e. the actual
      * autosplitters (also controlling icon display, etc.) */
     FluffelIPCThread ipcthread;
+    quint64 ipcOverflows = 0;
+
+    /* Number of ingame timer pauses and resumes done by IPC; reported with each pong */
+    quint64 ipcTransitions = 0;
+
+    /* State published by an autosplitter through shared memory (optional) */
+    FluffelSharedState sharedState;
+    void processIPCEvent(const FluffelIPCThread::listenerEvent &event);
+    void processIPCCommand(const FluffelIPCThread::listenerEvent &event);
+
+    /* Thread that publishes the state to overlays and other tools (optional). The
+     * state last published is kept to send only what changed. */
+    FluffelPublisher publisher;
+    bool publishing = false;
+
+    enum timerState { timerReset = 0, timerPaused = 1, timerRunning = 2 };
+
+    struct publishedState {
+        int realTimer = -1;
+        int ingameTimer = -1;
+        unsigned int section = 0;
+        int splits = -1;
+        QBitArray icons;
+        bool valid = false;
+    } published;
+
+    void publishState();
+    void publishMessage(const QString &event, QJsonObject &message);
 
     /* Object to control the real and ingame timer */
     TimeController timeControl;
 
-    /* Split data object and the segments that are shown in the main window */
+    /* Split data object and the segments that are shown in the main window. These only
+     * refer to the segments of the split data; their times are formatted once when the
+     * segments change. */
     SplitData data;
-    QList<SplitData::segment> displaySegments;
+    QVector<SplitData::segment> displaySegments;
+
+    struct segmentStrings {
+        QStaticText title;
+        QString time;
+        QString diff;
+    };
+
+    QVector<segmentStrings> displayStrings;
+    int updateDisplaySegments();
+
+    /* Times that change while the timers run; they are only formatted again if the
+     * centisecond shown changed */
+    struct liveString {
+        qint64 centis = 0;
+        bool negative = false;
+        QString text;
+    };
+
+    liveString liveRealTimer;
+    liveString liveIngameTimer;
+    liveString liveSegmentTime;
+    liveString liveSegmentDiff;
+    const QString &formatLiveTime(liveString &live, qint64 time, bool diff = false);
+
+    /* Journal of the run for restoring it after a crash (optional) */
+    FluffelJournal journal;
+    QString journalFilename;
+    void setupJournal();
 
     /* Painting functions and tools */
-    void paintAllElements(QPainter &painter);
+    void paintFrame(QPainter &painter, const QRect &dirty);
+    void paintStaticElements(QPainter &painter, int currentLine);
+    void paintDynamicElements(QPainter &painter, const QRect &dirty);
 
-    void paintText(QPainter &painter, const QRect &rect, const QFont &font, const QColor &color, const QString &text, int flags);
+    void paintText(QPainter &painter, const QRect &rect, FluffelTheme::font font, FluffelTheme::color color, const QString &text, int flags);
+    void paintTime(QPainter &painter, const QRect &rect, FluffelTheme::font font, FluffelTheme::color color, const QString &text, int flags);
+    void paintTitle(QPainter &painter, const QRect &rect, FluffelTheme::font font, FluffelTheme::color color, const QStaticText &text);
     void paintSeparator(QPainter &painter, const QPoint& start, const QPoint &end);
 
-    void paintSegmentLine(QPainter &painter, const QRect &rect, SplitData::segment &segment);
-    void paintSegmentLinePast(QPainter &painter, const QRect& rect, SplitData::segment &segment);
-    void paintSegmentLineCurrent(QPainter &painter, const QRect& rect, SplitData::segment &segment);
-    void paintSegmentLineFuture(QPainter &painter, const QRect& rect, SplitData::segment &segment);
+    void paintSegmentLine(QPainter &painter, const QRect &rect, const SplitData::segment &segment, const segmentStrings &strings);
+    void paintSegmentLinePast(QPainter &painter, const QRect& rect, const SplitData::segment &segment, const segmentStrings &strings);
+    void paintSegmentLineCurrent(QPainter &painter, const QRect& rect, const SplitData::segment &segment, const segmentStrings &strings);
+    void paintSegmentLineFuture(QPainter &painter, const QRect& rect, const SplitData::segment &segment, const segmentStrings &strings);
 
 
 
@@ -131,7 +262,36 @@ class MainWindow : public QMainWindow {
     QRect regionTitle;
     QRect regionTimeList;
     QRect regionStatus;
+    QRect rectRealTimer;
+    QRect rectIngameTimer;
     void calculateRegionSizes();
+
+    QRect getSegmentLineRect(int line) const;
+    int getCurrentSegmentLine();
+
+    /* Everything except the timers and the current segment only changes on splits,
+     * resets, loading, icon changes or new settings. It is painted once into this
+     * pixmap, so each tick only repaints the dirty rects of the timers and the
+     * current segment on top of it. The layer is also painted again if the current
+     * line differs from the one it was painted with; if only icon states changed,
+     * just their cells are painted again. */
+    QPixmap staticLayer;
+    bool staticLayerValid = false;
+    int staticLayerLine = -1;
+    QBitArray staticLayerIcons;
+    void invalidateStaticLayer();
+
+    /* Digits of the times for each font and color (indexed by font * colorCount + color) */
+    QVector<FluffelGlyphAtlas> glyphAtlases;
+    const FluffelGlyphAtlas &getGlyphAtlas(FluffelTheme::font font, FluffelTheme::color color);
+    void updateStaticLayer();
+    void updateStaticLayerIcons();
+    void updateDynamicRegions();
+
+    /* Centiseconds of the times last shown; only regions whose text changes are repainted */
+    qint64 shownRealCentis = -1;
+    qint64 shownIngameCentis = -1;
+    qint64 shownSegmentCentis = -1;
 };
 
 #endif // MAINWINDOW_H
@@ -1,4 +1,8 @@
 #include "splitdata.h"
+#include "fluffeljournal.h"
+#include "fluffeltimer.h"
+
+#include <QDateTime>
 
 SplitData::SplitData() {
 
@@ -10,9 +14,11 @@ SplitData::~SplitData() {
 
 void SplitData::loadData(const QString& filename) {
     /* Clear all old segments */
-    allSegments.clear();
-    futureSegments.clear();
-    pastSegments.clear();
+    segments.clear();
+    runTimes.clear();
+    bestTimes.clear();
+    history.close();
+    resetAttempt();
 
     qDebug("loading data from %s", filename.toStdString().c_str());
 
@@ -30,6 +36,18 @@ void SplitData::loadData(const QString& filename) {
         /* Read in line */
         QString line = in.readLine();
 
+        /* The part of the times below 1 ms (in ns) of the segment above. It starts with
+         * '#', so that older versions just ignore it. */
+        if (line.startsWith("#NS:")) {
+            QStringList fields = line.mid(4).split(",");
+
+            if ((fields.size() == 2) && !segments.isEmpty()) {
+                runTimes.last() += qBound(Q_INT64_C(0), fields.at(0).toLongLong(), FluffelTimer::nsecsPerMSec - 1);
+                bestTimes.last() += qBound(Q_INT64_C(0), fields.at(1).toLongLong(), FluffelTimer::nsecsPerMSec - 1);
+            }
+            continue;
+        }
+
         /* Ignore empty lines and lines starting with '#' */
         if (line.startsWith('#') || (line.trimmed().size() == 0)) {
             continue;
@@ -50,29 +68,34 @@ void SplitData::loadData(const QString& filename) {
         }
 
         /* Prepare structure, fill in the fields, and add to list */
-        segment segmentData;
+        entry segmentData;
         segmentData.title = fields.at(0);
-        segmentData.runtime = fields.at(1).toLongLong();
-        segmentData.besttime = fields.at(2).toLongLong();
         segmentData.section = fields.at(3).toLongLong();
 
-        allSegments.push_back(segmentData);
+        segments.push_back(segmentData);
+        runTimes.append(fields.at(1).toLongLong() * FluffelTimer::nsecsPerMSec);
+        bestTimes.append(fields.at(2).toLongLong() * FluffelTimer::nsecsPerMSec);
     }
 
-    qDebug("Loaded %d segments from file", allSegments.size());
+    qDebug("Loaded %d segments from file", segments.size());
 
-    /* Calculate the total times */
-    calculateTotalTimes(false);
+    /* Calculate the total times and make room for the times of an attempt */
+    totalTimes.resize(segments.size());
+    calculateTotalTimes();
 
-    /* Then copy simply the items over and renew the lists */
-    futureSegments = QList<segment>(allSegments);
-    pastSegments.clear();
-    totalPastTime = 0;
-    totalImproTime = 0;
+    attemptRunTimes.resize(segments.size());
+    attemptTotalTimes.resize(segments.size());
+    attemptImproTimes.resize(segments.size());
+    attemptTotalImproTimes.resize(segments.size());
+    attemptSkipped.resize(segments.size());
 
-    /* Close file and then copy the list to future segments */
+    /* Close file */
     this->filename = filename;
     file.close();
+
+    history.open(FluffelHistory::filenameOf(filename), segments.size());
+
+    record(FluffelJournal::recordLoad, filename.toUtf8());
 }
 
 void SplitData::saveData(const QString& filename) {
@@ -91,15 +114,38 @@ void SplitData::saveData(const QString& filename) {
     /* Write title of run */
     out << "TITLE: " << title << "\n\n";
 
-    /* Write a line for each segment */
-    for (int i = 0; i < allSegments.size(); ++i) {
-        segment data = allSegments[i];
-        out << data.title << ", " << data.runtime << ", " << data.besttime << ", " << data.section << "\n";
+    /* Write a line for each segment with the times in ms. If the times are more exact,
+     * the rest is written in an extra line. */
+    for (int i = 0; i < segments.size(); ++i) {
+        const entry &data = segments[i];
+        out << data.title << ", " << runTimes[i] / FluffelTimer::nsecsPerMSec << ", "
+            << bestTimes[i] / FluffelTimer::nsecsPerMSec << ", " << data.section << "\n";
+
+        qint64 runtimeNSecs = runTimes[i] % FluffelTimer::nsecsPerMSec;
+        qint64 besttimeNSecs = bestTimes[i] % FluffelTimer::nsecsPerMSec;
+
+        if ((runtimeNSecs != 0) || (besttimeNSecs != 0)) {
+            out << "#NS: " << runtimeNSecs << ", " << besttimeNSecs << "\n";
+        }
     }
 
     /* Close file */
     this->filename = filename;
     file.close();
+
+    /* The history moves along to the new file (e.g. the one saved at exit). It is
+     * moved, not copied, so there is only one history that keeps growing, even if
+     * every session is saved under a new name. */
+    QString historyFilename = FluffelHistory::filenameOf(filename);
+    if (historyFilename != history.getFilename()) {
+        if (history.isOpen() && QFile::exists(history.getFilename()) && !QFile::exists(historyFilename)) {
+            if (!QFile::rename(history.getFilename(), historyFilename)) {
+                qDebug("Could not move history %s to %s.", history.getFilename().toStdString().c_str(), historyFilename.toStdString().c_str());
+            }
+        }
+
+        history.open(historyFilename, segments.size());
+    }
 }
 
 QString SplitData::getTitle() const {
@@ -111,7 +157,7 @@ void SplitData::setTitle(const QString& value) {
 }
 
 QString SplitData::getLongestSegmentTitle() const {
-    if (allSegments.size() == 0) {
+    if (segments.size() == 0) {
         return QString("");
     }
 
@@ -119,92 +165,129 @@ QString SplitData::getLongestSegmentTitle() const {
     int length = 0;
     int index = 0;
 
-    for (int i = 0; i < allSegments.size(); ++i) {
-        if (allSegments[i].title.length() > length) {
-            length = allSegments[i].title.length();
+    for (int i = 0; i < segments.size(); ++i) {
+        if (segments[i].title.length() > length) {
+            length = segments[i].title.length();
             index = i;
         }
     }
 
-    return allSegments[index].title;
+    return segments[index].title;
+}
+
+int SplitData::getSegmentCount() const {
+    return segments.size();
+}
+
+SplitData::segment SplitData::getSegment(int index) const {
+    const entry &data = segments[index];
+
+    segment value;
+    value.index = index;
+    value.current = (index == current);
+    value.besttime = bestTimes[index];
+    value.section = data.section;
+
+    /* Segments before the cursor ran in this attempt. Skipped ones keep the times
+     * of the split file, like the ones still to come. */
+    if (index < current) {
+        value.ran = true;
+        value.skipped = attemptSkipped.testBit(index);
+    }
+
+    if (value.ran && !value.skipped) {
+        value.runtime = attemptRunTimes[index];
+        value.totaltime = attemptTotalTimes[index];
+        value.improtime = attemptImproTimes[index];
+        value.totalimprotime = attemptTotalImproTimes[index];
+    } else {
+        value.runtime = runTimes[index];
+        value.totaltime = totalTimes[index];
+    }
+
+    return value;
+}
+
+const QString& SplitData::getSegmentTitle(int index) const {
+    return segments[index].title;
 }
 
 unsigned int SplitData::getCurrentSection() const {
-    /* Return the section number of the first element of future segments, which is
-     * the current section. Should there be no elements left then return zero */
-    if (futureSegments.size() == 0) {
+    /* Return the section number of the segment at the cursor, which is the current
+     * section. Should there be no segments left then return zero */
+    if (current >= segments.size()) {
         return 0;
     }
 
-    return futureSegments[0].section;
+    return segments[current].section;
 }
 
-int SplitData::getCurrentSegments(QList<SplitData::segment>& list, int lines) const {
-    /* Current segment is the first row in futureSegments. If there is nothing left
-     * in futureSegments, then get all the lines from pastSegments. */
-    if (futureSegments.size() == 0) {
-        return getSegments(list, pastSegments, lines, true);
-    }
+int SplitData::getCurrentSegments(QVector<SplitData::segment>& list, int lines) const {
+    int past = current;
+    int future = segments.size() - current;
 
     int pastlines = 0;
     int futurelines = 0;
 
-    /* If there are less than (lines / 2) + 1 segments left in futureSegments, then we
-     * fill up with pastSegments (if possible) */
-    if (futureSegments.size() < ((lines / 2) + 1)) {
-        pastlines = getSegments(list, pastSegments, lines - futureSegments.size(), true);
-        futurelines = getSegments(list, futureSegments, futureSegments.size());
+    if (future == 0) {
+        /* Nothing left to run, so all lines are taken from the past segments */
+        pastlines = qMin(lines, past);
+    } else if (future < ((lines / 2) + 1)) {
+        /* If there are less than (lines / 2) + 1 segments left in the future, then we
+         * fill up with past segments (if possible) */
+        pastlines = qBound(0, lines - future, past);
+        futurelines = future;
     } else {
         /* Now there half lines left for past segments. Subtract one for the current
-         * segment line */
-        pastlines = getSegments(list, pastSegments, (lines-1) / 2, true);
-
-        /* Now there are lines-1 left for the future lines */
-        futurelines = getSegments(list, futureSegments, lines - pastlines - 1);
+         * segment line. The rest is left for the future lines. */
+        pastlines = qMin((lines - 1) / 2, past);
+        futurelines = qBound(0, lines - pastlines - 1, future);
     }
 
-    /* Mark the current time */
-    if (futurelines > 0) {
-        list[pastlines].current = true;
+    /* The last segment is always shown, even if the lines end before it */
+    int count = pastlines + futurelines;
+    bool addLast = (future > futurelines);
+
+    list.resize(addLast ? count + 1 : count);
+    for (int i = 0; i < count; ++i) {
+        list[i] = getSegment(current - pastlines + i);
     }
 
-    /* Finally add the last segment from the future if it is not already added. */
-    if (futureSegments.size() > futurelines) {
-        list.push_back(futureSegments.last());
-        futurelines++;
+    if (addLast) {
+        list[count++] = getSegment(segments.size() - 1);
     }
 
-    return pastlines + futurelines;
+    return count;
 }
 
 int SplitData::split(qint64 curtime) {
     /* Splits the current segment using curtime. Returns >0 if possible and 0
      * if there is nothing more to split. */
-    if (futureSegments.size() == 0) {
+    if (current >= segments.size()) {
         return 0;
     }
 
-    /* Take the first item of futureSegments */
-    segment splitSegment = futureSegments.takeFirst();
+    /* A split cannot be before the one before it */
+    curtime = qMax(curtime, totalPastTime);
+
+    record(FluffelJournal::recordSplit, QByteArray(reinterpret_cast<const char*>(&curtime), sizeof(curtime)));
 
     /* Split time */
     qint64 splittime = curtime - totalPastTime;
 
     /* Save the current time as run time and calculate the positive/negative improvement */
-    splitSegment.ran = true;
-    splitSegment.improtime = splittime - splitSegment.runtime;
-    splitSegment.totalimprotime = totalImproTime + splitSegment.improtime;
-    splitSegment.runtime = splittime;
-    splitSegment.totaltime = curtime;
-
-    /* Put the splitted segment to the _front_ of pastSegments to reverse the order */
-    pastSegments.push_front(splitSegment);
+    attemptSkipped.clearBit(current);
+    attemptImproTimes[current] = splittime - runTimes[current];
+    attemptTotalImproTimes[current] = totalImproTime + attemptImproTimes[current];
+    attemptRunTimes[current] = splittime;
+    attemptTotalTimes[current] = curtime;
 
     /* Add last run time to the total past time */
-    totalPastTime += splitSegment.runtime;
-    totalImproTime += splitSegment.improtime;
+    totalPastTime += splittime;
+    totalImproTime += attemptImproTimes[current];
 
-    return futureSegments.size();
+    current++;
+    return segments.size() - current;
 }
 
 int SplitData::splitToSection(unsigned int section, qint64 curtime) {
@@ -212,119 +295,175 @@ int SplitData::splitToSection(unsigned int section, qint64 curtime) {
 
     /* Splits the current segment using curtime. Returns >0 if possible and 0
      * if there is nothing more to split. */
-    if (futureSegments.size() == 0) {
+    if (current >= segments.size()) {
         return 0;
     }
 
-    /* If the very first element in futureSegments has already the mission number or
-     * any higher then the one we want to jump to, we do nothing. */
-    if (futureSegments.first().section >= section) {
-        return futureSegments.size();
+    /* If the current segment has already the mission number or any higher then the
+     * one we want to jump to, we do nothing. */
+    if (segments[current].section >= section) {
+        return segments.size() - current;
     }
 
-    /* The first element in futureSegments is the current segment and this segment
-     * should point to the mission given. Remove all others, step by step. */
-    while((futureSegments.size() > 0) && (futureSegments.first().section != section)) {
-        /* In contrast to the split function, we do not add times to these removed
-         * ones before we add them to the _front_ of pastSegments. Just mark them
-         * as "ran". */
-        segment splitSegment = futureSegments.takeFirst();
+    /* A split cannot be before the one before it */
+    curtime = qMax(curtime, totalPastTime);
 
-        splitSegment.ran = true;
+    QByteArray payload(reinterpret_cast<const char*>(&section), sizeof(section));
+    payload.append(reinterpret_cast<const char*>(&curtime), sizeof(curtime));
+    record(FluffelJournal::recordSplitToSection, payload);
 
-        pastSegments.push_front(splitSegment);
+    /* The current segment should point to the mission given. Move the cursor over all
+     * others, step by step. In contrast to the split function, we do not add times to
+     * these; they are just marked as skipped. */
+    while ((current < segments.size()) && (segments[current].section != section)) {
+        attemptSkipped.setBit(current);
+        current++;
     }
 
-    /* The first one in pastSegments is now the run we add the time */
-    if (pastSegments.size() > 0) {
+    /* The last one passed is now the run we add the time */
+    if (current > 0) {
+        int last = current - 1;
+
         /* Split time */
         qint64 splittime = curtime - totalPastTime;
 
-        pastSegments.first().improtime = splittime - pastSegments.first().runtime;
-        pastSegments.first().totalimprotime = totalImproTime + pastSegments.first().improtime;
-        pastSegments.first().runtime = splittime;
-        pastSegments.first().totaltime = curtime;
+        attemptSkipped.clearBit(last);
+        attemptImproTimes[last] = splittime - runTimes[last];
+        attemptTotalImproTimes[last] = totalImproTime + attemptImproTimes[last];
+        attemptRunTimes[last] = splittime;
+        attemptTotalTimes[last] = curtime;
 
         /* Don't forget to add this here. Since we skipped some segments this
          * whole last segment will have all the runtime. */
-        totalPastTime += pastSegments.first().runtime;
-        totalImproTime += pastSegments.first().improtime;
+        totalPastTime += splittime;
+        totalImproTime += attemptImproTimes[last];
     }
 
-    return futureSegments.size();
+    return segments.size() - current;
 }
 
 bool SplitData::canSplit() const {
-    /* Returns true if there a futureSegments left otherwise false (which means
+    /* Returns true if there are segments left otherwise false (which means
      * that no more splits are possible) */
-    return futureSegments.size() > 0;
+    return current < segments.size();
 }
 
 bool SplitData::hasSplit() const {
-    /* Returns true if there was already a split, i.e. there is an element in
-     * pastSegments, otherwise false. */
-    return pastSegments.size() > 0;
+    /* Returns true if there was already a split, i.e. the cursor moved */
+    return current > 0;
+}
+
+int SplitData::getSplitCount() const {
+    return current;
+}
+
+bool SplitData::getLastSplit(SplitData::segment& value) const {
+    /* The latest segment is right before the cursor */
+    if (current == 0) {
+        return false;
+    }
+
+    value = getSegment(current - 1);
+    return true;
+}
+
+int SplitData::skip() {
+    if (current >= segments.size()) {
+        return 0;
+    }
+
+    record(FluffelJournal::recordSkip);
+
+    /* Like the skipped segments in splitToSection, the segment is marked as "ran"
+     * but does not get a time. */
+    attemptSkipped.setBit(current);
+    current++;
+
+    return segments.size() - current;
+}
+
+int SplitData::undoSplit() {
+    if (current == 0) {
+        return segments.size();
+    }
+
+    record(FluffelJournal::recordUndo);
+
+    /* Take back the time of the last segment if it got one. The split file data was
+     * never changed, so moving the cursor back restores the segment. */
+    current--;
+
+    if (!attemptSkipped.testBit(current)) {
+        totalPastTime -= attemptRunTimes[current];
+        totalImproTime -= attemptImproTimes[current];
+    }
+
+    return segments.size() - current;
 }
 
 void SplitData::reset(bool merge) {
-    qDebug("reset: %d past, %d future", pastSegments.size(), futureSegments.size());
+    qDebug("reset: %d past, %d future", current, segments.size() - current);
 
-    /* Merging means that we need to go through the list of pastSegments in reverse order and
-     * check if the run times were better (smaller) than the best times */
+    quint8 mergeValue = merge ? 1 : 0;
+    record(FluffelJournal::recordDataReset, QByteArray(reinterpret_cast<const char*>(&mergeValue), sizeof(mergeValue)));
+
+    if (historyEnabled && (current > 0)) {
+        history.append(attemptRunTimes.data(), attemptSkipped, current, QDateTime::currentMSecsSinceEpoch() / 1000);
+    }
+
+    /* Merging means that we need to go through the segments before the cursor and
+     * check if the run times were better (smaller) than the best times. Skipped
+     * segments keep their times. */
     if (merge) {
         qDebug("merging");
-        int pastelements = pastSegments.size();
-        for (int i = 0; i < pastelements; ++i) {
-            segment data = pastSegments[pastelements - i - 1];
+        for (int i = 0; i < current; ++i) {
+            if (attemptSkipped.testBit(i)) {
+                continue;
+            }
 
-            allSegments[i].runtime = data.runtime;
-            if (data.runtime < allSegments[i].besttime) {
-                allSegments[i].besttime = data.runtime;
+            runTimes[i] = attemptRunTimes[i];
+            if (attemptRunTimes[i] < bestTimes[i]) {
+                bestTimes[i] = attemptRunTimes[i];
             }
         }
 
         /* Recalculate total times */
-        calculateTotalTimes(false);
+        calculateTotalTimes();
     }
 
-    /* Then copy simply the items over and renew the lists */
-    futureSegments = QList<segment>(allSegments);
-    pastSegments.clear();
-    totalPastTime = 0;
-    totalImproTime = 0;
+    resetAttempt();
+}
 
-    qDebug("after reset: %d past, %d future", pastSegments.size(), futureSegments.size());
+const FluffelHistory& SplitData::getHistory() const {
+    return history;
+}
+
+void SplitData::setHistoryEnabled(bool value) {
+    historyEnabled = value;
 }
 
 QString SplitData::getFilename() const {
     return filename;
 }
 
+void SplitData::setJournal(FluffelJournal* value) {
+    journal = value;
+}
 
-int SplitData::getSegments(QList<segment>& toList, const QList<segment>& fromList, int lines, bool backwards) const {
-    /* Empty list */
-    if (fromList.isEmpty()) {
-        return 0;
-    }
-
-    /* Start copying elements. From the front of the list! */
-    lines = qMin(lines, fromList.size());
-    for(int i = 0; i < lines; ++i) {
-        int index = backwards ? lines - i - 1: i;
-        toList.push_back(fromList[index]);
+void SplitData::record(quint8 type, const QByteArray& payload) {
+    if (journal != nullptr) {
+        journal->record(type, FluffelTimer::monotonicNSecs(), payload);
     }
-
-    return lines;
 }
 
-void SplitData::calculateTotalTimes(bool best) {
-    qint64 totaltime = 0;
-
-    for(int i = 0; i < allSegments.size(); ++i) {
-        /* Add either best or run time to the total */
-        qint64 addtime = best ? allSegments[i].besttime : allSegments[i].runtime;
+void SplitData::resetAttempt() {
+    /* The times of the attempt are overwritten by the next splits */
+    current = 0;
+    totalPastTime = 0;
+    totalImproTime = 0;
+}
 
-        totaltime = allSegments[i].totaltime = totaltime + addtime;
-        totalImproTime = allSegments[i].totalimprotime = totalImproTime + allSegments[i].improtime;
-    }
+void SplitData::calculateTotalTimes() {
+    /* Add up the run times */
+    FluffelTimeColumn::prefixSum(runTimes.data(), totalTimes.data(), runTimes.size());
 }
@@ -1,10 +1,16 @@
 #ifndef SPLITDATA_H
 #define SPLITDATA_H
 
+#include <QBitArray>
 #include <QFile>
-#include <QList>
 #include <QString>
 #include <QTextStream>
+#include <QVector>
+
+#include "fluffelhistory.h"
+#include "fluffeltimecolumn.h"
+
+class FluffelJournal;
 
 class SplitData {
   public:
@@ -15,11 +21,14 @@ class SplitData {
     void loadData(const QString &filename);
     void saveData(const QString &filename);
 
-    /* Segment */
+    /* Segment as it is shown; all times are in ns. It is a view of the segment with
+     * the given index and the times of the current attempt (if it ran already), so it
+     * does not own its title (see getSegmentTitle). */
     struct segment {
-        QString title;
+        int index = 0;
         bool ran = false;
-        bool current = false;        
+        bool current = false;
+        bool skipped = false;
         qint64 runtime = 0;
         qint64 besttime = 0;
         qint64 totaltime = 0;
@@ -35,34 +44,78 @@ class SplitData {
     /* Get longest segment title */
     QString getLongestSegmentTitle() const;
 
+    /* Number of segments, a segment by its index and its title */
+    int getSegmentCount() const;
+    segment getSegment(int index) const;
+    const QString &getSegmentTitle(int index) const;
+
     /* Get the current section */
     unsigned int getCurrentSection() const;
 
     /* Gets n lines of segments around the current one
-     * plus the last one. Returns the real number of
-     * lines added (if less). */
-    int getCurrentSegments(QList<segment>& list, int lines) const;
+     * plus the last one. The list is replaced, but keeps
+     * its memory. Returns the real number of lines (if
+     * less). */
+    int getCurrentSegments(QVector<segment>& list, int lines) const;
 
-    /* Split, returns the number of segments remaining in futureSegments */
+    /* Split, returns the number of segments remaining */
     int split(qint64 curtime);
     int splitToSection(unsigned int section, qint64 curtime);
     bool canSplit() const;
     bool hasSplit() const;
 
-    /* Resets the list and merges times if wanted */
+    /* Number of segments split (or skipped) so far and the latest of them. getLastSplit
+     * returns false if there is none. */
+    int getSplitCount() const;
+    bool getLastSplit(segment &value) const;
+
+    /* Skips the current segment without a time (its time is added to the next split)
+     * and undoes the last split or skip. Both return the number of segments remaining. */
+    int skip();
+    int undoSplit();
+
+    /* Resets the list and merges times if wanted. An attempt with at least one split
+     * is added to the history, also if it is not merged. */
     void reset(bool merge = false);
 
+    /* All attempts of the split file (see FluffelHistory). Adding attempts can be
+     * turned off, e.g. while the journal is replayed, since its attempts are already
+     * in the history. */
+    const FluffelHistory &getHistory() const;
+    void setHistoryEnabled(bool value);
+
     QString getFilename() const;
 
+    /* Every change of the segments is recorded in this journal (if set) */
+    void setJournal(FluffelJournal *value);
+
   private:
-    /* Segment lists: all segments contains all segments in a list.
-     * futureSegments contains all segments that still have to be
-     * run in normal order. pastSegments contains all past segments
-     * in reversed order (i.e. the latest segment run is at the front
-     * of the list) */
-    QList<segment> allSegments;
-    QList<segment> futureSegments;
-    QList<segment> pastSegments;
+    /* A segment of the split file; its times are in the columns below */
+    struct entry {
+        QString title;
+        unsigned int section = 0;
+    };
+
+    /* All segments in the order of the run. The segment at the cursor is run now
+     * (current is the number of segments if the run is over); all segments before
+     * it were split or skipped. A split only moves the cursor. */
+    QVector<entry> segments;
+    int current = 0;
+
+    /* Times of the split file (last run and best time) and the running total of
+     * the last run, one column entry per segment */
+    FluffelTimeColumn runTimes;
+    FluffelTimeColumn bestTimes;
+    FluffelTimeColumn totalTimes;
+
+    /* Times of the current attempt, one column entry per segment. Only the
+     * entries before the cursor are valid, so nothing is copied or cleared on
+     * a split, undo, or reset. */
+    FluffelTimeColumn attemptRunTimes;
+    FluffelTimeColumn attemptTotalTimes;
+    FluffelTimeColumn attemptImproTimes;
+    FluffelTimeColumn attemptTotalImproTimes;
+    QBitArray attemptSkipped;
 
     /* Keep track of the total runtime of all past segments. Makes it
      * easier to  calculate the difference to the current time. */
@@ -73,12 +126,17 @@ class SplitData {
     QString title;
     QString filename;
 
-    /* Gets n lines or less from a segment queue Returns
-     * the real number of lines added (if less). */
-    int getSegments(QList<segment>& toList, const QList<segment> &fromList, int lines, bool backwards = false) const;    
+    FluffelHistory history;
+    bool historyEnabled = true;
+
+    FluffelJournal *journal = nullptr;
+    void record(quint8 type, const QByteArray &payload = QByteArray());
+
+    /* Sets the current attempt back to the first segment */
+    void resetAttempt();
 
-    /* Calculate total time of all segments. Can use either run times or the best times. */
-    void calculateTotalTimes(bool best = false);
+    /* Calculate total time of all segments from the run times */
+    void calculateTotalTimes();
 };
 
 #endif // SPLITDATA_H
@@ -1,4 +1,5 @@
 #include "timecontroller.h"
+#include "fluffeljournal.h"
 
 TimeController::TimeController() {
     preferredTime = prefTime::prefIngameTime;
@@ -7,19 +8,18 @@ TimeController::TimeController() {
 TimeController::~TimeController() {
 }
 
+/* The functions without a timestamp act at the current time, so that they can be
+ * recorded in the journal like all others */
 void TimeController::startBothTimer() {
-    timeIngame.start();
-    timeReal.start();
+    startBothTimerAt(clock->nsecs());
 }
 
 void TimeController::pauseBothTimer() {
-    timeIngame.pause();
-    timeReal.pause();
+    pauseBothTimerAt(clock->nsecs());
 }
 
 void TimeController::resumeBothTimer() {
-    timeIngame.resume();
-    timeReal.resume();
+    resumeBothTimerAt(clock->nsecs());
 }
 
 void TimeController::toggleBothTimer() {
@@ -31,13 +31,14 @@ void TimeController::toggleBothTimer() {
 }
 
 void TimeController::restartBothTimer() {
-    timeIngame.restart();
-    timeReal.restart();
+    startBothTimer();
 }
 
 void TimeController::resetBothTimer() {
     timeIngame.invalidate();
     timeReal.invalidate();
+
+    record(FluffelJournal::recordReset, clock->nsecs());
 }
 
 bool TimeController::areBothTimerValid() {
@@ -93,17 +94,73 @@ quint64 TimeController::elapsedPreferredTime() {
 }
 
 void TimeController::pauseIngameTimer() {
-    timeIngame.pause();
+    pauseIngameTimerAt(clock->nsecs());
 }
 
 void TimeController::resumeIngameTimer() {
-    timeIngame.resume();
+    resumeIngameTimerAt(clock->nsecs());
 }
 
 bool TimeController::isIngameTimerRunning() {
     return !timeIngame.isPaused();
 }
 
+void TimeController::setIngameTime(qint64 time) {
+    setIngameTimeAt(time, clock->nsecs());
+}
+
+void TimeController::setIngameTimeAt(qint64 time, qint64 timestamp) {
+    timeIngame.setElapsedAt(time, timestamp);
+
+    if (journal != nullptr) {
+        journal->record(FluffelJournal::recordSetIngameTime, timestamp,
+                        QByteArray(reinterpret_cast<const char*>(&time), sizeof(time)));
+    }
+}
+
+void TimeController::startBothTimerAt(qint64 timestamp) {
+    timeIngame.startAt(timestamp);
+    timeReal.startAt(timestamp);
+
+    record(FluffelJournal::recordStart, timestamp);
+}
+
+void TimeController::pauseBothTimerAt(qint64 timestamp) {
+    timeIngame.pauseAt(timestamp);
+    timeReal.pauseAt(timestamp);
+
+    record(FluffelJournal::recordPause, timestamp);
+}
+
+void TimeController::resumeBothTimerAt(qint64 timestamp) {
+    timeIngame.resumeAt(timestamp);
+    timeReal.resumeAt(timestamp);
+
+    record(FluffelJournal::recordResume, timestamp);
+}
+
+void TimeController::pauseIngameTimerAt(qint64 timestamp) {
+    timeIngame.pauseAt(timestamp);
+
+    record(FluffelJournal::recordPauseIngame, timestamp);
+}
+
+void TimeController::resumeIngameTimerAt(qint64 timestamp) {
+    timeIngame.resumeAt(timestamp);
+
+    record(FluffelJournal::recordResumeIngame, timestamp);
+}
+
+quint64 TimeController::elapsedPreferredTimeAt(qint64 timestamp) {
+    FluffelTimer &timer = (preferredTime == prefTime::prefIngameTime) ? timeIngame : timeReal;
+
+    if (timer.isValid()) {
+        return timer.elapsed_with_pause_at(timestamp);
+    }
+
+    return 0;
+}
+
 QString TimeController::getStringFromTime(qint64 time) {
     return FluffelTimer::getStringFromTime(time);
 }
@@ -111,3 +168,25 @@ QString TimeController::getStringFromTime(qint64 time) {
 QString TimeController::getStringFromTimeDiff(qint64 timediff) {
     return FluffelTimer::getStringFromTimeDiff(timediff);
 }
+
+void TimeController::setJournal(FluffelJournal* value) {
+    Q_ASSERT((value == nullptr) || (clock == FluffelClock::monotonic()));
+    journal = value;
+}
+
+void TimeController::setClock(FluffelClock* value) {
+    Q_ASSERT((journal == nullptr) || (value == FluffelClock::monotonic()));
+    clock = value;
+    timeIngame.setClock(value);
+    timeReal.setClock(value);
+}
+
+FluffelClock* TimeController::getClock() const {
+    return clock;
+}
+
+void TimeController::record(quint8 type, qint64 timestamp) {
+    if (journal != nullptr) {
+        journal->record(type, timestamp);
+    }
+}
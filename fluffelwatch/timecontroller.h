@@ -3,6 +3,8 @@
 
 #include "fluffeltimer.h"
 
+class FluffelJournal;
+
 class TimeController
 {
     public:
@@ -21,6 +23,8 @@ class TimeController
         bool areBothTimerRunning();
         bool isAnyTimerRunning();
 
+        /* All times are in ns; the strings show centiseconds */
+
         quint64 elapsedRealTime();
         QString elapsedRealTimeString();
 
@@ -45,11 +49,35 @@ class TimeController
 
         bool isIngameTimerRunning();
 
+        /* Sets the ingame time in ns (e.g. to the time shown by the game) */
+        void setIngameTime(qint64 time);
+
+        /* Versions of the functions above for events that happened at the given
+         * time of the clock (in ns, usually FluffelTimer::monotonicNSecs).
+         * This keeps the times exact even if the event is processed later. */
+        void startBothTimerAt(qint64 timestamp);
+        void pauseBothTimerAt(qint64 timestamp);
+        void resumeBothTimerAt(qint64 timestamp);
+        void pauseIngameTimerAt(qint64 timestamp);
+        void resumeIngameTimerAt(qint64 timestamp);
+        void setIngameTimeAt(qint64 time, qint64 timestamp);
+
+        quint64 elapsedPreferredTimeAt(qint64 timestamp);
+
         /* These are just forward functions to the respective static
          * FluffelTimer functions. */
         static QString getStringFromTime(qint64 time);
         static QString getStringFromTimeDiff(qint64 timediff);
 
+        /* Every change of the timers is recorded in this journal (if set) */
+        void setJournal(FluffelJournal *value);
+
+        /* Clock of both timers (the monotonic system clock by default). Changing it
+         * resets the timers. The journal and the IPC clients use the monotonic clock
+         * for their times, so another clock cannot be combined with a journal. */
+        void setClock(FluffelClock *value);
+        FluffelClock *getClock() const;
+
     private:
         /* Define two timers:
          * one for the ingame time that can be paused externally by IPC and
@@ -59,6 +87,10 @@ class TimeController
 
         /* Preferred time defines what time is returned by elapsedPrefTime() */
         prefTime preferredTime;
+
+        FluffelJournal *journal = nullptr;
+        FluffelClock *clock = FluffelClock::monotonic();
+        void record(quint8 type, qint64 timestamp);
 };
 
 #endif // TIMECONTROLLER_H
@@ -0,0 +1,256 @@
+#include "fluffelfood.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+const char FluffelFood::defaultSocket[] = "/tmp/fluffelwatch";
+
+/* Try to reconnect at most once per second */
+const int64_t FluffelFood::reconnectInterval = 1000000000;
+
+/* If Fluffelwatch does not read for this long, the connection is dropped and
+ * established again (instead of buffering more and more) */
+const size_t FluffelFood::maxPendingBytes = 65536;
+
+FluffelFood::FluffelFood() {
+    fd = -1;
+    timestamps = false;
+    active = false;
+
+    lastTimestamp = 0;
+    hasSent = false;
+
+    outboundPos = 0;
+    lastAttempt = 0;
+}
+
+FluffelFood::~FluffelFood() {
+    disconnect();
+}
+
+bool FluffelFood::connect(const std::string& socketPath, bool timestamps) {
+    closeSocket();
+
+    path = socketPath;
+    this->timestamps = timestamps;
+    active = true;
+
+    /* Try right away */
+    lastAttempt = 0;
+    return reconnect();
+}
+
+void FluffelFood::disconnect() {
+    closeSocket();
+    active = false;
+}
+
+bool FluffelFood::isConnected() const {
+    return fd != -1;
+}
+
+bool FluffelFood::send(uint8_t control, uint32_t section, uint32_t iconstates, int64_t timestamp) {
+    current.timercontrol = control;
+    current.section = section;
+    current.iconstates = iconstates;
+
+    if (timestamp == 0) {
+        timestamp = monotonicNSecs();
+    }
+
+    /* A new connection sends the last state first, so reconnect before taking the new one */
+    bool connected = reconnect();
+
+    /* Nothing changed, so nothing to send. One-time commands are never redundant
+     * since they are reset below. */
+    bool redundant = hasSent && (memcmp(&current, &lastSent, sizeof(current)) == 0);
+    if (!redundant) {
+        if (connected) {
+            queue(current, timestamp);
+        }
+
+        lastSent = current;
+        lastTimestamp = timestamp;
+        hasSent = true;
+    }
+
+    if (current.timercontrol >= FluffelProtocol::timeControlStart) {
+        current.timercontrol = FluffelProtocol::timeControlNone;
+        lastSent.timercontrol = FluffelProtocol::timeControlNone;
+    }
+
+    if (connected) {
+        flush();
+    }
+
+    return isConnected();
+}
+
+bool FluffelFood::sendCurrentState(int64_t timestamp) {
+    return send(current.timercontrol, current.section, current.iconstates, timestamp);
+}
+
+bool FluffelFood::flush() {
+    if (!reconnect()) {
+        return false;
+    }
+
+    while (outboundPos < outbound.size()) {
+        ssize_t written = ::send(fd, outbound.data() + outboundPos, outbound.size() - outboundPos, MSG_NOSIGNAL);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            /* Fluffelwatch is busy, try again with the next send */
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+
+            /* Fluffelwatch was closed */
+            closeSocket();
+            return false;
+        }
+
+        outboundPos += written;
+    }
+
+    if (outboundPos == outbound.size()) {
+        outbound.clear();
+        outboundPos = 0;
+        return true;
+    }
+
+    if (outbound.size() - outboundPos > maxPendingBytes) {
+        closeSocket();
+        return false;
+    }
+
+    /* Keep only what is left */
+    outbound.erase(outbound.begin(), outbound.begin() + outboundPos);
+    outboundPos = 0;
+    return false;
+}
+
+size_t FluffelFood::getPendingBytes() const {
+    return outbound.size() - outboundPos;
+}
+
+void FluffelFood::clearState() {
+    current = FluffelProtocol::listenerData();
+}
+
+void FluffelFood::updateControl(uint8_t control) {
+    current.timercontrol = control;
+}
+
+void FluffelFood::updateSection(uint32_t section) {
+    current.section = section;
+}
+
+void FluffelFood::updateIconstate(uint32_t iconstates) {
+    current.iconstates = iconstates;
+}
+
+void FluffelFood::clearIconstate() {
+    current.iconstates = 0;
+}
+
+void FluffelFood::updateIcons(const std::vector<int>& icons) {
+    uint32_t iconstates = 0;
+    for (int icon : icons) {
+        iconstates |= getIconstate(icon);
+    }
+
+    current.iconstates = iconstates;
+}
+
+uint32_t FluffelFood::getIconstate(int icon) {
+    if ((icon < 1) || (icon > 32)) {
+        return 0;
+    }
+
+    return 1u << (icon - 1);
+}
+
+int64_t FluffelFood::monotonicNSecs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+bool FluffelFood::reconnect() {
+    if (fd != -1) {
+        return true;
+    }
+
+    if (!active) {
+        return false;
+    }
+
+    int64_t now = monotonicNSecs();
+    if ((lastAttempt != 0) && (now - lastAttempt < reconnectInterval)) {
+        return false;
+    }
+    lastAttempt = now;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    /* Local sockets connect immediately or not at all */
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        closeSocket();
+        return false;
+    }
+
+    if (timestamps) {
+        FluffelProtocol::helloData hello;
+        hello.version = FluffelProtocol::versionTimestamped;
+
+        const char *data = reinterpret_cast<const char*>(&hello);
+        outbound.insert(outbound.end(), data, data + sizeof(hello));
+    }
+
+    /* Fluffelwatch does not know anything about this client yet */
+    if (hasSent) {
+        queue(lastSent, lastTimestamp);
+    }
+
+    return true;
+}
+
+void FluffelFood::closeSocket() {
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    outbound.clear();
+    outboundPos = 0;
+}
+
+void FluffelFood::queue(const FluffelProtocol::listenerData& state, int64_t timestamp) {
+    if (timestamps) {
+        FluffelProtocol::timestampedData data;
+        data.state = state;
+        data.timestamp = timestamp;
+
+        const char *bytes = reinterpret_cast<const char*>(&data);
+        outbound.insert(outbound.end(), bytes, bytes + sizeof(data));
+    } else {
+        const char *bytes = reinterpret_cast<const char*>(&state);
+        outbound.insert(outbound.end(), bytes, bytes + sizeof(state));
+    }
+}
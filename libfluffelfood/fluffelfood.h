@@ -0,0 +1,87 @@
+#ifndef FLUFFELFOOD_H
+#define FLUFFELFOOD_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fluffelprotocol.h"
+
+/* Client for fluffelfood programs written in C++; the counterpart of
+ * fluffelfood/fluffelwatch.py. Keeps track of the state sent, so that e.g.
+ * only the icons can be updated without restating section and control.
+ *
+ * Sending never blocks: data is written to the socket as far as it takes it
+ * and the rest is kept until the next send (or flush). A state that equals
+ * the last one sent is not sent again. If Fluffelwatch is not running (yet)
+ * or the connection is lost, the client reconnects on its own during the
+ * next sends and then sends the current state. One-time commands (start,
+ * stop) that could not be sent before a connection was lost are not
+ * repeated. */
+class FluffelFood {
+  public:
+    FluffelFood();
+    ~FluffelFood();
+
+    /* Default location of the Fluffelwatch socket */
+    static const char defaultSocket[];
+
+    /* Connects to Fluffelwatch. With timestamps enabled, each state is sent with
+     * the time it changed, so Fluffelwatch can pause and split at the exact time.
+     * Returns false if Fluffelwatch cannot be reached right now; the connection
+     * is then retried automatically. */
+    bool connect(const std::string &socketPath = defaultSocket, bool timestamps = false);
+    void disconnect();
+    bool isConnected() const;
+
+    /* Sends a state. The time of the change (CLOCK_MONOTONIC in ns) can be given,
+     * otherwise the current time is used. Returns false if the state could not
+     * be handed to the socket (not connected); it is sent after reconnecting. */
+    bool send(uint8_t control, uint32_t section, uint32_t iconstates, int64_t timestamp = 0);
+    bool sendCurrentState(int64_t timestamp = 0);
+
+    /* Writes data left over from earlier sends; returns true if nothing is left */
+    bool flush();
+    size_t getPendingBytes() const;
+
+    /* Updates parts of the state without sending it */
+    void clearState();
+    void updateControl(uint8_t control);
+    void updateSection(uint32_t section);
+    void updateIconstate(uint32_t iconstates);
+    void clearIconstate();
+
+    /* Sets the icons from a list of 1-based icon numbers as in the settings file */
+    void updateIcons(const std::vector<int> &icons);
+    static uint32_t getIconstate(int icon);
+
+    /* Current time as used for the timestamps */
+    static int64_t monotonicNSecs();
+
+  private:
+    int fd;
+    std::string path;
+    bool timestamps;
+    bool active;
+
+    /* State to send and the last state handed to the socket */
+    FluffelProtocol::listenerData current;
+    FluffelProtocol::listenerData lastSent;
+    int64_t lastTimestamp;
+    bool hasSent;
+
+    /* Data that the socket did not take yet */
+    std::vector<char> outbound;
+    size_t outboundPos;
+
+    int64_t lastAttempt;
+
+    static const int64_t reconnectInterval;
+    static const size_t maxPendingBytes;
+
+    bool reconnect();
+    void closeSocket();
+    void queue(const FluffelProtocol::listenerData &state, int64_t timestamp);
+};
+
+#endif // FLUFFELFOOD_H
@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# libfluffelfood: static library for fluffelfood programs written in C++.
+# Plain C++, shares the protocol header with Fluffelwatch.
+#
+#-------------------------------------------------
+
+TARGET = fluffelfood
+TEMPLATE = lib
+
+CONFIG += staticlib c++11
+CONFIG -= qt
+
+INCLUDEPATH += ../fluffelwatch
+
+SOURCES += \
+    fluffelfood.cpp
+
+HEADERS += \
+    fluffelfood.h \
+    ../fluffelwatch/fluffelprotocol.h